@@ -7,10 +7,14 @@
 #include <algorithm>
 #include <array>
 #include <cassert>
+#include <cmath>
 #include <cstddef>
 #include <cstdint>
+#include <limits>
+#include <memory>
 #include <tuple>
 #include <type_traits>
+#include <utility>
 #include <vector>
 
 #if defined(_DEBUG) && (defined(WIN32) || defined(_WINDOWS))
@@ -26,6 +30,25 @@ DKM - A k-means implementation that is generic across variable data dimensions.
 */
 namespace dkm {
 
+/*
+How kmeans_lloyd finds the closest mean of every point in each iteration. All methods produce the same labels.
+
+naive:    compare every point with every mean.
+annulus:  Hamerly's bounds, searching only the means whose distance from the centre of the data is close to the
+          point's (Hamerly and Drake's Annulus algorithm).
+exponion: Hamerly's bounds, searching only the means in a ball around the point's current mean (Newling and
+          Fleuret's Exponion algorithm).
+ball:     no bounds, every cluster is a ball around its mean and a point is only compared with the neighbouring
+          balls whose boundary with its own is closer to the mean than the point (Xia et al.'s Ball k-means).
+
+The bounded methods skip most distance calculations once the means settle and pay off most for points of roughly
+10 to 50 dimensions, where Hamerly's single lower bound alone prunes poorly. They keep two bounds per point.
+Ball k-means needs no memory per point beyond the labels and computes one distance per point and iteration plus
+those to the neighbouring balls, which suits large k. All of them compare all pairs of means in every iteration,
+so they suit k up to the low thousands.
+*/
+enum class assignment { naive, annulus, exponion, ball };
+
 /*
 These functions are all private implementation details and shouldn't be referenced outside of this
 file.
@@ -49,7 +72,38 @@ template <typename T, size_t N>
 T distance(const std::array<T, N>& point_a, const std::array<T, N>& point_b) {
     return std::sqrt(distance_squared(point_a, point_b));
 }
-    
+
+// Dimensions from which closest_mean uses partial distance search, and the number of dimensions summed between
+// two checks against the bound
+const size_t partial_distance_min_dimensions = 64;
+const size_t partial_distance_block = 32;
+
+/*
+Calculate the square of the distance between two points like distance_squared, but give up as soon as the running
+sum reaches `bound`, returning a value no smaller than `bound`. The dimensions are summed in the same order as in
+distance_squared, so a distance below the bound is bit-for-bit the same. Since the running sum never decreases,
+stopping early can't hide a distance below the bound.
+*/
+template <typename T, size_t N>
+T distance_squared_bounded(const std::array<T, N>& point_a, const std::array<T, N>& point_b, T bound) {
+	T d_squared = T();
+	size_t i = 0;
+	for (; i + partial_distance_block <= N; i += partial_distance_block) {
+		for (size_t j = i; j < i + partial_distance_block; ++j) {
+			auto delta = point_a[j] - point_b[j];
+			d_squared += delta * delta;
+		}
+		if (d_squared >= bound) {
+			return d_squared;
+		}
+	}
+	for (; i < N; ++i) {
+		auto delta = point_a[i] - point_b[i];
+		d_squared += delta * delta;
+	}
+	return d_squared;
+}
+
 /*
  Calculate the mean square float distance between a collection of points.
  */
@@ -57,16 +111,16 @@ template <typename T, size_t N>
 float point_collection_epsilon(const std::vector< std::array<T, N> >& point_a, const std::vector< std::array<T, N> >& point_b) {
     assert( point_a.size() == point_b.size() );
     float d_squared = 0.0f;
-    std::array<T, N> means_a;
-    std::array<T, N> means_b;
-    for (int dim=0; dim<N; dim++){
-        for (int pointIndex=0; pointIndex<point_a.size();pointIndex++){
+    std::array<T, N> means_a{};
+    std::array<T, N> means_b{};
+    for (size_t dim=0; dim<N; dim++){
+        for (size_t pointIndex=0; pointIndex<point_a.size();pointIndex++){
             means_a[dim]+= point_a[pointIndex][dim];
         }
         means_a[dim]/=point_a.size();
     }
-    for (int dim=0; dim<N; dim++){
-        for (int pointIndex=0; pointIndex<point_b.size();pointIndex++){
+    for (size_t dim=0; dim<N; dim++){
+        for (size_t pointIndex=0; pointIndex<point_b.size();pointIndex++){
             means_b[dim]+= point_b[pointIndex][dim];
         }
         means_b[dim]/=point_b.size();
@@ -100,6 +154,12 @@ std::vector<T> closest_distance(
 This is an alternate initialization method based on the [kmeans++](https://en.wikipedia.org/wiki/K-means%2B%2B)
 initialization algorithm.
 
+The distance of every point to its closest mean is updated incrementally as means are added. Points are grouped
+by their closest mean, and the triangle inequality skips every point, and every whole group, that is at most half
+the new mean's distance away from its current closest mean, since the new mean can't be closer. The bound keeps a
+margin for rounding, so the weights, and hence the means picked for a given seed, are exactly those of
+recomputing all distances in every round.
+
 A default seed value can help to make things reproducible. This argument was added to fix Rhythmiq's save-load system.
 More info [here](https://github.com/accusonus/rhythmiq/issues/844)
 */
@@ -124,9 +184,55 @@ template <typename T, size_t N>
 		means.push_back(data[uniform_generator(rand_engine)]);
 	}
 
+	// Squared distance of every point to its closest mean, the points closest to each mean and the largest of
+	// their squared distances (an upper bound until the group is scanned again)
+	std::vector<T> distances(data.size());
+	std::vector<std::vector<size_t>> members(1, std::vector<size_t>(data.size()));
+	std::vector<double> radius(1, 0.0);
+	for (size_t i = 0; i < data.size(); ++i) {
+		distances[i] = distance_squared(data[i], means[0]);
+		members[0][i] = i;
+		radius[0] = std::max(radius[0], static_cast<double>(distances[i]));
+	}
+	// the new mean can't be closer than the current one if |new - current|^2 >= 4 * distance^2, with a margin for
+	// the rounding of both sides
+	const double margin = 4.0 * (1.0 + 8.0 * (N + 2) * static_cast<double>(std::numeric_limits<T>::epsilon()));
+
 	for (uint32_t count = 1; count < k; ++count) {
-		// Calculate the distance to the closest mean for each data point
-		auto distances = details::closest_distance(means, data, k);
+		if (count > 1) {
+			const auto& added = means.back();
+			const uint32_t added_index = count - 1;
+			members.emplace_back();
+			radius.push_back(0.0);
+			for (uint32_t j = 0; j < added_index; ++j) {
+				double centres = 0.0;
+				for (size_t dim = 0; dim < N; ++dim) {
+					double delta = static_cast<double>(means[j][dim]) - static_cast<double>(added[dim]);
+					centres += delta * delta;
+				}
+				if (centres >= margin * radius[j]) {
+					continue;
+				}
+				size_t kept = 0;
+				double largest = 0.0;
+				for (size_t m = 0; m < members[j].size(); ++m) {
+					size_t i = members[j][m];
+					if (centres < margin * static_cast<double>(distances[i])) {
+						T d = distance_squared(data[i], added);
+						if (d < distances[i]) {
+							distances[i] = d;
+							members[added_index].push_back(i);
+							radius[added_index] = std::max(radius[added_index], static_cast<double>(d));
+							continue;
+						}
+					}
+					members[j][kept++] = i;
+					largest = std::max(largest, static_cast<double>(distances[i]));
+				}
+				members[j].resize(kept);
+				radius[j] = largest;
+			}
+		}
 		// Pick a random point weighted by the distance from existing means
 		// TODO: This might convert floating point weights to ints, distorting the distribution for small weights
 #if !defined(_MSC_VER) || _MSC_VER >= 1900
@@ -146,7 +252,8 @@ template <typename T, size_t N>
 }
 
 /*
-Calculate the index of the mean a particular data point is closest to (euclidean distance)
+Calculate the index of the mean a particular data point is closest to (euclidean distance). For points with many
+dimensions the distance to a mean is abandoned once it exceeds the smallest distance found so far.
 */
 template <typename T, size_t N>
 uint32_t closest_mean(const std::array<T, N>& point, const std::vector<std::array<T, N>>& means) {
@@ -155,7 +262,8 @@ uint32_t closest_mean(const std::array<T, N>& point, const std::vector<std::arra
 	typename std::array<T, N>::size_type index = 0;
 	T distance;
 	for (size_t i = 1; i < means.size(); ++i) {
-		distance = distance_squared(point, means[i]);
+		distance = N >= partial_distance_min_dimensions ? distance_squared_bounded(point, means[i], smallest_distance)
+														: distance_squared(point, means[i]);
 		if (distance < smallest_distance) {
 			smallest_distance = distance;
 			index = i;
@@ -206,6 +314,419 @@ std::vector<std::array<T, N>> calculate_means(const std::vector<std::array<T, N>
 	return means;
 }
 
+/*
+The assignment step of kmeans_lloyd for the annulus and exponion methods.
+
+Every point keeps an upper bound on the distance to its mean and a lower bound on the distance to any other mean.
+Moving the means loosens both bounds by how far the means moved. A point whose upper bound is below its lower
+bound, or below half the distance from its mean to the nearest other mean, keeps its label without computing any
+distance. Otherwise the upper bound is tightened and, if that doesn't settle it either, the point searches a
+region that has to contain its closest mean:
+
+annulus:  the means whose distance from the centre of the data differs from the point's by at most the distance
+          to its mean or its previous second closest mean, whichever is larger.
+exponion: the means within 2 u + 2 s of its current mean, where u is the distance to that mean and s half the
+          distance from it to the nearest other mean, found in the list of means sorted by distance from it.
+
+The bounds are kept in double with a margin for the rounding of the distances, so a mean is only ruled out when
+its computed distance is certainly larger, and the labels, ties broken towards the lowest index included, are
+exactly those of calculate_clusters.
+*/
+template <typename T, size_t N>
+class bounded_assignment {
+public:
+	bounded_assignment(const std::vector<std::array<T, N>>& data, assignment method)
+		: data_(data),
+		  method_(method),
+		  labels_(data.size(), 0),
+		  seconds_(data.size(), 0),
+		  upper_(data.size(), 0.0),
+		  lower_(data.size(), 0.0),
+		  origin_(),
+		  norms_(method == assignment::annulus ? data.size() : 0) {
+		assert(method == assignment::annulus || method == assignment::exponion);
+		// relative error of a computed squared distance, with room for the double arithmetic on the bounds
+		rounding_ = 8.0 * (N + 2) *
+			(static_cast<double>(std::numeric_limits<T>::epsilon()) + std::numeric_limits<double>::epsilon());
+		ratio_ = 1.0 + 2.0 * rounding_;
+		if (method == assignment::annulus) {
+			for (auto& point : data) {
+				for (size_t d = 0; d < N; ++d) {
+					origin_[d] += static_cast<double>(point[d]);
+				}
+			}
+			for (auto& o : origin_) {
+				o /= static_cast<double>(std::max<size_t>(data.size(), 1));
+			}
+			for (size_t i = 0; i < data.size(); ++i) {
+				norms_[i] = norm(data[i]);
+			}
+		}
+	}
+
+	/*
+	Label every point with the index of its closest mean in `means`, which must have the same size on every call.
+	*/
+	const std::vector<uint32_t>& update(const std::vector<std::array<T, N>>& means) {
+		const uint32_t k = static_cast<uint32_t>(means.size());
+		if (k == 1) {
+			return labels_;
+		}
+		if (previous_.empty()) {
+			assign_all(means);
+		} else {
+			prepare(means);
+			for (size_t i = 0; i < data_.size(); ++i) {
+				update_point(i, means);
+			}
+		}
+		previous_ = means;
+		return labels_;
+	}
+
+private:
+	static double distance_double(const std::array<T, N>& a, const std::array<T, N>& b) {
+		double sum = 0.0;
+		for (size_t d = 0; d < N; ++d) {
+			double delta = static_cast<double>(a[d]) - static_cast<double>(b[d]);
+			sum += delta * delta;
+		}
+		return std::sqrt(sum);
+	}
+
+	double norm(const std::array<T, N>& point) const {
+		double sum = 0.0;
+		for (size_t d = 0; d < N; ++d) {
+			double delta = static_cast<double>(point[d]) - origin_[d];
+			sum += delta * delta;
+		}
+		return std::sqrt(sum);
+	}
+
+	// bounds on the exact distance from a computed squared distance
+	double upper_bound(T d_squared) const { return std::sqrt(static_cast<double>(d_squared)) * (1.0 + rounding_); }
+	double lower_bound(T d_squared) const { return std::sqrt(static_cast<double>(d_squared)) * (1.0 - rounding_); }
+
+	// a point is certainly closer to its mean than to any other if this holds for its bounds
+	bool settled(double upper, double lower) const { return upper * ratio_ < lower; }
+
+	void assign_all(const std::vector<std::array<T, N>>& means) {
+		for (size_t i = 0; i < data_.size(); ++i) {
+			T best = T(), second = T();
+			uint32_t best_index = 0, second_index = 0;
+			for (uint32_t j = 0; j < means.size(); ++j) {
+				T d = distance_squared(data_[i], means[j]);
+				if (j == 0 || d < best) {
+					second = best;
+					second_index = best_index;
+					best = d;
+					best_index = j;
+				} else if (j == 1 || d < second) {
+					second = d;
+					second_index = j;
+				}
+			}
+			labels_[i] = best_index;
+			seconds_[i] = second_index;
+			upper_[i] = upper_bound(best);
+			lower_[i] = lower_bound(second);
+		}
+	}
+
+	// Loosen the bounds by the movement of the means and prepare the distances between them for the searches.
+	void prepare(const std::vector<std::array<T, N>>& means) {
+		const uint32_t k = static_cast<uint32_t>(means.size());
+		drift_.assign(k, 0.0);
+		uint32_t largest = 0;
+		double second_largest = 0.0;
+		for (uint32_t j = 0; j < k; ++j) {
+			drift_[j] = distance_double(previous_[j], means[j]) * (1.0 + rounding_);
+			if (drift_[j] > drift_[largest]) {
+				second_largest = drift_[largest];
+				largest = j;
+			} else if (j != largest) {
+				second_largest = std::max(second_largest, drift_[j]);
+			}
+		}
+		for (size_t i = 0; i < data_.size(); ++i) {
+			upper_[i] += drift_[labels_[i]];
+			lower_[i] -= labels_[i] == largest ? second_largest : drift_[largest];
+		}
+
+		centres_.assign(static_cast<size_t>(k) * k, 0.0);
+		half_nearest_.assign(k, std::numeric_limits<double>::max());
+		for (uint32_t a = 0; a < k; ++a) {
+			for (uint32_t b = a + 1; b < k; ++b) {
+				double d = distance_double(means[a], means[b]) * (1.0 - rounding_);
+				centres_[a * k + b] = centres_[b * k + a] = d;
+				half_nearest_[a] = std::min(half_nearest_[a], 0.5 * d);
+				half_nearest_[b] = std::min(half_nearest_[b], 0.5 * d);
+			}
+		}
+
+		if (method_ == assignment::annulus) {
+			sorted_.resize(k);
+			for (uint32_t j = 0; j < k; ++j) {
+				sorted_[j] = {norm(means[j]), j};
+			}
+			std::sort(sorted_.begin(), sorted_.end());
+		} else {
+			// row a lists the other means by increasing distance from mean a
+			sorted_.resize(static_cast<size_t>(k) * (k - 1));
+			for (uint32_t a = 0; a < k; ++a) {
+				auto row = sorted_.begin() + static_cast<size_t>(a) * (k - 1);
+				auto out = row;
+				for (uint32_t b = 0; b < k; ++b) {
+					if (b != a) {
+						*out++ = {centres_[a * k + b], b};
+					}
+				}
+				std::sort(row, out);
+			}
+		}
+	}
+
+	void update_point(size_t i, const std::vector<std::array<T, N>>& means) {
+		const uint32_t k = static_cast<uint32_t>(means.size());
+		const auto& point = data_[i];
+		const uint32_t a = labels_[i];
+		const double bound = std::max(lower_[i], half_nearest_[a]);
+		if (settled(upper_[i], bound)) {
+			return;
+		}
+		T best = distance_squared(point, means[a]);
+		upper_[i] = upper_bound(best);
+		if (settled(upper_[i], bound)) {
+			return;
+		}
+
+		uint32_t best_index = a, second_index = a;
+		T second = std::numeric_limits<T>::max();
+		auto consider = [&](uint32_t j) {
+			T d = distance_squared(point, means[j]);
+			if (d < best || (d == best && j < best_index)) {
+				second = best;
+				second_index = best_index;
+				best = d;
+				best_index = j;
+			} else if (d < second || second_index == best_index) {
+				second = d;
+				second_index = j;
+			}
+		};
+		// lower bound on the distance to every mean outside the searched region, which is chosen so that all of
+		// them are certainly farther than the current mean
+		double outside;
+		if (method_ == assignment::annulus) {
+			const uint32_t b = seconds_[i];
+			const double radius = std::max(upper_[i], upper_bound(distance_squared(point, means[b]))) * ratio_;
+			const double x = norms_[i];
+			const double width = radius + rounding_ * (2.0 * x + radius);
+			auto first = std::lower_bound(sorted_.begin(), sorted_.end(), std::make_pair(x - width, uint32_t(0)));
+			for (auto it = first; it != sorted_.end() && it->first <= x + width; ++it) {
+				if (it->second != a) {
+					consider(it->second);
+				}
+			}
+			outside = radius;
+		} else {
+			const double radius = (upper_[i] * (1.0 + ratio_) + 2.0 * half_nearest_[a]) * ratio_;
+			auto row = sorted_.begin() + static_cast<size_t>(a) * (k - 1);
+			for (auto it = row; it != row + (k - 1) && it->first <= radius; ++it) {
+				consider(it->second);
+			}
+			outside = radius * (1.0 - rounding_) - upper_[i];
+		}
+
+		labels_[i] = best_index;
+		seconds_[i] = second_index;
+		upper_[i] = upper_bound(best);
+		lower_[i] = second_index != best_index ? std::min(lower_bound(second), outside) : outside;
+	}
+
+	const std::vector<std::array<T, N>>& data_;
+	assignment method_;
+	std::vector<uint32_t> labels_;
+	// second closest mean of every point as of its last search, for the annulus radius
+	std::vector<uint32_t> seconds_;
+	std::vector<double> upper_;
+	std::vector<double> lower_;
+	// centre of the data and the distance of every point from it, for the annulus search
+	std::array<double, N> origin_;
+	std::vector<double> norms_;
+	double rounding_;
+	double ratio_;
+	std::vector<std::array<T, N>> previous_;
+	std::vector<double> drift_;
+	// distances between all pairs of means and half the distance from every mean to its nearest neighbour
+	std::vector<double> centres_;
+	std::vector<double> half_nearest_;
+	// means by distance from the centre (annulus) or, per mean, the other means by distance from it (exponion)
+	std::vector<std::pair<double, uint32_t>> sorted_;
+};
+
+/*
+The assignment step of kmeans_lloyd for Ball k-means.
+
+Every cluster is a ball around its mean holding the points labelled with it. The points of another ball j can only
+be closer to a point of ball i if the point is at least half the distance between the two means away from mean i.
+So each mean keeps the other means sorted by distance, and a point is compared with them only while half that
+distance is within its own distance from mean i: points closer to the mean than half the distance to the nearest
+other mean (the stable area) are settled after a single distance, and the others only visit the neighbouring balls
+of the annulus they are in. Every ball also keeps its radius, the largest distance of its points from its mean,
+grown by how far the mean moves. A ball whose radius is below half the distance to the nearest other mean lies
+entirely in its stable area, and its points keep their label without computing any distance. Nothing is kept per
+point except the label.
+
+Half the distances between means are rounded down and the point's distance up, as in bounded_assignment, so the
+labels are exactly those of calculate_clusters.
+*/
+template <typename T, size_t N>
+class ball_assignment {
+public:
+	explicit ball_assignment(const std::vector<std::array<T, N>>& data) : data_(data) {
+		rounding_ = 8.0 * (N + 2) *
+			(static_cast<double>(std::numeric_limits<T>::epsilon()) + std::numeric_limits<double>::epsilon());
+	}
+
+	/*
+	Label every point with the index of its closest mean in `means`, which must have the same size on every call.
+	*/
+	const std::vector<uint32_t>& update(const std::vector<std::array<T, N>>& means) {
+		const uint32_t k = static_cast<uint32_t>(means.size());
+		skipped_ = 0;
+		if (labels_.empty() || k == 1) {
+			labels_ = calculate_clusters(data_, means);
+			// the radii are only known once the points' distances have been computed
+			radius_.assign(k, std::numeric_limits<double>::infinity());
+			old_means_ = means;
+			return labels_;
+		}
+
+		// row a lists half the distance from mean a to every other mean, nearest first
+		neighbours_.resize(static_cast<size_t>(k) * (k - 1));
+		for (uint32_t a = 0; a < k; ++a) {
+			auto row = neighbours_.begin() + static_cast<size_t>(a) * (k - 1);
+			auto out = row;
+			for (uint32_t b = 0; b < k; ++b) {
+				if (b != a) {
+					*out++ = {0.5 * std::sqrt(squared(means[a], means[b])) * (1.0 - rounding_), b};
+				}
+			}
+			std::sort(row, out);
+		}
+
+		// a ball that, moved along with its mean, still lies closer to its mean than half the distance to the nearest
+		// other mean keeps all its points
+		const double ratio = (1.0 + rounding_) * (1.0 + 2.0 * rounding_);
+		stable_.resize(k);
+		for (uint32_t a = 0; a < k; ++a) {
+			const double drift = std::sqrt(squared(means[a], old_means_[a]));
+			radius_[a] = (radius_[a] + drift * ratio) * (1.0 + rounding_);
+			stable_[a] = radius_[a] < neighbours_[static_cast<size_t>(a) * (k - 1)].first;
+			if (!stable_[a]) {
+				radius_[a] = 0.0;
+			}
+		}
+
+		for (size_t i = 0; i < data_.size(); ++i) {
+			if (stable_[labels_[i]]) {
+				++skipped_;
+				continue;
+			}
+			const auto& point = data_[i];
+			uint32_t best_index = labels_[i];
+			T best = distance_squared(point, means[best_index]);
+			const double reach = std::sqrt(static_cast<double>(best)) * ratio;
+			auto row = neighbours_.begin() + static_cast<size_t>(best_index) * (k - 1);
+			for (auto it = row; it != row + (k - 1) && it->first <= reach; ++it) {
+				const uint32_t j = it->second;
+				T d = distance_squared(point, means[j]);
+				if (d < best || (d == best && j < best_index)) {
+					best = d;
+					best_index = j;
+				}
+			}
+			labels_[i] = best_index;
+			// points moving into a stable ball grow its radius as well
+			radius_[best_index] = std::max(radius_[best_index], std::sqrt(static_cast<double>(best)) * ratio);
+		}
+		old_means_ = means;
+		return labels_;
+	}
+
+	/*
+	Number of points the last update kept in their ball without computing any distance.
+	*/
+	size_t skipped() const { return skipped_; }
+
+private:
+	static double squared(const std::array<T, N>& a, const std::array<T, N>& b) {
+		double sum = 0.0;
+		for (size_t d = 0; d < N; ++d) {
+			double delta = static_cast<double>(a[d]) - static_cast<double>(b[d]);
+			sum += delta * delta;
+		}
+		return sum;
+	}
+
+	const std::vector<std::array<T, N>>& data_;
+	std::vector<uint32_t> labels_;
+	double rounding_;
+	std::vector<std::pair<double, uint32_t>> neighbours_;
+	// the means of the previous update, and an upper bound on the distance of every ball's points from them
+	std::vector<std::array<T, N>> old_means_;
+	std::vector<double> radius_;
+	std::vector<char> stable_;
+	size_t skipped_ = 0;
+};
+
+/*
+The iterations of kmeans_lloyd, with the naive assignment step done by `naive(data, means)`, which returns the
+label of every point like calculate_clusters. libdkm passes its vectorised kernels here.
+*/
+template <typename T, size_t N, typename Assign>
+std::tuple<std::vector<std::array<T, N>>, std::vector<uint32_t>> lloyd(const std::vector<std::array<T, N>>& data,
+	uint32_t k,
+	int maxIter,
+	int seed,
+	float epsilon,
+	assignment method,
+	Assign naive) {
+	static_assert(std::is_arithmetic<T>::value && std::is_signed<T>::value,
+		"kmeans_lloyd requires the template parameter T to be a signed arithmetic type (e.g. float, double, int)");
+	assert(k > 0); // k must be greater than zero
+	assert(maxIter > 0); //Maximum kmeans iterations must be greater than zero
+	assert(data.size() >= k); // there must be at least k data points
+	std::vector<std::array<T, N>> means = random_plusplus(data, k, seed);
+
+	std::vector<std::array<T, N>> old_means;
+	std::vector<uint32_t> clusters;
+	std::unique_ptr<bounded_assignment<T, N>> bounds;
+	std::unique_ptr<ball_assignment<T, N>> balls;
+	if (method == assignment::annulus || method == assignment::exponion) {
+		bounds.reset(new bounded_assignment<T, N>(data, method));
+	} else if (method == assignment::ball) {
+		balls.reset(new ball_assignment<T, N>(data));
+	}
+	// Calculate new means until convergence is reached
+	int count = 0;
+	do {
+		if (bounds) {
+			clusters = bounds->update(means);
+		} else if (balls) {
+			clusters = balls->update(means);
+		} else {
+			clusters = naive(data, means);
+		}
+		old_means = means;
+		means = calculate_means(data, clusters, old_means, k);
+		++count;
+	} while (point_collection_epsilon(means, old_means) > epsilon && count < maxIter);
+
+	return std::tuple<std::vector<std::array<T, N>>, std::vector<uint32_t>>(means, clusters);
+}
+
 } // namespace details
 
 
@@ -228,29 +749,14 @@ used for initializing the means.
 
 @param seed     the default engine seed number for the initialization of kmeans++.
                 By default (seed = -1) the kmeans++ algorithm chooses the cluster center at random.
+@param method   how the closest mean of every point is found, see dkm::assignment. The result doesn't depend
+                on it.
 */
 template <typename T, size_t N>
 std::tuple<std::vector<std::array<T, N>>, std::vector<uint32_t>> kmeans_lloyd(
-	const std::vector<std::array<T, N>>& data, uint32_t k, int maxIter, int seed=-1, float epsilon=0.0f) {
-	static_assert(std::is_arithmetic<T>::value && std::is_signed<T>::value,
-		"kmeans_lloyd requires the template parameter T to be a signed arithmetic type (e.g. float, double, int)");
-	assert(k > 0); // k must be greater than zero
-    assert(maxIter > 0); //Maximum kmeans iterations must be greater than zero
-	assert(data.size() >= k); // there must be at least k data points
-	std::vector<std::array<T, N>> means = details::random_plusplus(data, k, seed);
-
-	std::vector<std::array<T, N>> old_means;
-	std::vector<uint32_t> clusters;
-	// Calculate new means until convergence is reached
-	int count = 0;
-	do {
-		clusters = details::calculate_clusters(data, means);
-		old_means = means;
-		means = details::calculate_means(data, clusters, old_means, k);
-		++count;
-	} while (details::point_collection_epsilon(means, old_means) > epsilon && count < maxIter);
-
-	return std::tuple<std::vector<std::array<T, N>>, std::vector<uint32_t>>(means, clusters);
+	const std::vector<std::array<T, N>>& data, uint32_t k, int maxIter, int seed=-1, float epsilon=0.0f,
+	assignment method=assignment::naive) {
+	return details::lloyd(data, k, maxIter, seed, epsilon, method, &details::calculate_clusters<T, N>);
 }
     
 
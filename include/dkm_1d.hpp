@@ -0,0 +1,134 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstdint>
+#include <limits>
+#include <numeric>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+#include "dkm.hpp"
+
+namespace dkm {
+
+namespace details {
+
+/*
+Sum of squared deviations from their mean of the sorted values first..last (inclusive), from prefix sums of the
+values and of their squares.
+*/
+inline double segment_cost(
+	const std::vector<double>& sums, const std::vector<double>& squares, size_t first, size_t last) {
+	const double count = static_cast<double>(last - first + 1);
+	const double sum = sums[last + 1] - sums[first];
+	return std::max(squares[last + 1] - squares[first] - sum * sum / count, 0.0);
+}
+
+/*
+One layer of the dynamic program for optimal 1-D k-means: cost[i] = min over j of previous[j - 1] + the cost of
+the segment j..i, for every i in first..last, where the best j is known to lie in low..high. The best j never
+decreases with i, so the middle i is solved first and splits both ranges in two (divide and conquer), which costs
+O(n log n) per layer. `start[i]` receives the best j.
+*/
+inline void optimal_1d_layer(const std::vector<double>& sums,
+	const std::vector<double>& squares,
+	const std::vector<double>& previous,
+	std::vector<double>& cost,
+	uint32_t* start,
+	size_t first,
+	size_t last,
+	size_t low,
+	size_t high) {
+	while (first <= last) {
+		const size_t middle = first + (last - first) / 2;
+		double best = std::numeric_limits<double>::infinity();
+		size_t best_j = low;
+		for (size_t j = low; j <= std::min(middle, high); ++j) {
+			double c = previous[j - 1] + segment_cost(sums, squares, j, middle);
+			if (c < best) {
+				best = c;
+				best_j = j;
+			}
+		}
+		cost[middle] = best;
+		start[middle] = static_cast<uint32_t>(best_j);
+		if (middle > first) {
+			optimal_1d_layer(sums, squares, previous, cost, start, first, middle - 1, low, best_j);
+		}
+		// continue with the upper half in this call to keep the recursion depth at O(log n)
+		first = middle + 1;
+		low = best_j;
+	}
+}
+
+} // namespace details
+
+
+/**
+ * Globally optimal k-means of one-dimensional data, e.g. loudness, tempo or onset strength.
+ *
+ * In one dimension the clusters of an optimal clustering are contiguous ranges of the sorted values, so after one
+ * sort a dynamic program over the number of clusters and the end of the last range finds the clustering with the
+ * smallest sum of squared distances (Wang and Song's Ckmeans.1d.dp). Every layer is solved by divide and conquer
+ * in O(n log n), for O(n log n + k n log n) time in all, and the result is deterministic: there's no seeding, and
+ * no need for several runs as with dkm::get_best_means. The start of every range is kept for all k layers, so
+ * memory is O(k n).
+ *
+ * @param data  Points to be clustered.
+ * @param k     Number of clusters, at most the number of points.
+ *
+ * @return std::tuple of the cluster means, in increasing order, and the cluster label of every point, as for
+ *         dkm::kmeans_lloyd.
+ */
+template <typename T>
+std::tuple<std::vector<std::array<T, 1>>, std::vector<uint32_t>> kmeans_1d(
+	const std::vector<std::array<T, 1>>& data, uint32_t k) {
+	static_assert(std::is_arithmetic<T>::value && std::is_signed<T>::value,
+		"kmeans_1d requires the template parameter T to be a signed arithmetic type (e.g. float, double, int)");
+	assert(k > 0);
+	assert(data.size() >= k);
+	const size_t n = data.size();
+	std::vector<uint32_t> order(n);
+	std::iota(order.begin(), order.end(), 0);
+	std::sort(order.begin(), order.end(), [&data](uint32_t a, uint32_t b) { return data[a][0] < data[b][0]; });
+
+	// prefix sums of the values relative to the median, which keeps the cancellation in segment_cost small
+	const double shift = static_cast<double>(data[order[n / 2]][0]);
+	std::vector<double> sums(n + 1, 0.0), squares(n + 1, 0.0);
+	for (size_t i = 0; i < n; ++i) {
+		double x = static_cast<double>(data[order[i]][0]) - shift;
+		sums[i + 1] = sums[i] + x;
+		squares[i + 1] = squares[i] + x * x;
+	}
+
+	// starts[m * n + i] is the first value of the last of m + 1 optimal ranges covering values 0..i
+	std::vector<uint32_t> starts(static_cast<size_t>(k) * n, 0);
+	std::vector<double> previous(n), cost(n);
+	for (size_t i = 0; i < n; ++i) {
+		previous[i] = details::segment_cost(sums, squares, 0, i);
+	}
+	for (uint32_t m = 1; m < k; ++m) {
+		// m + 1 ranges need at least m + 1 values; values beyond n - k + m leave too few for the remaining ranges
+		details::optimal_1d_layer(sums, squares, previous, cost, &starts[m * n], m, n - k + m, m, n - k + m);
+		std::swap(previous, cost);
+	}
+
+	std::vector<std::array<T, 1>> means(k);
+	std::vector<uint32_t> labels(n);
+	size_t last = n - 1;
+	for (uint32_t m = k; m-- > 0;) {
+		const size_t first = starts[m * n + last];
+		for (size_t i = first; i <= last; ++i) {
+			labels[order[i]] = m;
+		}
+		const double sum = sums[last + 1] - sums[first];
+		means[m][0] = static_cast<T>(sum / static_cast<double>(last - first + 1) + shift);
+		last = first - 1;
+	}
+	return std::tuple<std::vector<std::array<T, 1>>, std::vector<uint32_t>>(means, labels);
+}
+
+} // namespace dkm
@@ -0,0 +1,392 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "dkm.hpp"
+
+namespace dkm {
+
+namespace details {
+
+/*
+Every mean by its distance from each mean: row a, at a * k, lists the pairs (distance, mean) nearest first, mean a
+itself among them.
+*/
+template <typename T, size_t N>
+std::vector<std::pair<double, uint32_t>> mean_neighbours(const std::vector<std::array<T, N>>& means) {
+	const size_t k = means.size();
+	std::vector<std::pair<double, uint32_t>> rows(k * k);
+	for (size_t a = 0; a < k; ++a) {
+		for (size_t b = 0; b < k; ++b) {
+			double sum = 0.0;
+			for (size_t d = 0; d < N; ++d) {
+				double delta = static_cast<double>(means[a][d]) - static_cast<double>(means[b][d]);
+				sum += delta * delta;
+			}
+			rows[a * k + b] = {std::sqrt(sum), static_cast<uint32_t>(b)};
+		}
+		std::sort(rows.begin() + a * k, rows.begin() + (a + 1) * k);
+	}
+	return rows;
+}
+
+/*
+Write the c closest means of a point to out[0 .. c), as pairs (squared distance, mean) in increasing order, which
+puts the lowest index first on ties. The means are visited by their distance from mean `guess` and the search stops
+once the triangle inequality rules out all the rest, so near a good guess only a few distances are computed. The
+distances are compared with a margin for rounding, as in bounded_assignment, so the result is exactly that of
+sorting the distances to all means.
+*/
+template <typename T, size_t N>
+void nearest_means(const std::array<T, N>& point,
+	const std::vector<std::array<T, N>>& means,
+	const std::vector<std::pair<double, uint32_t>>& neighbours,
+	uint32_t guess,
+	uint32_t c,
+	std::pair<double, uint32_t>* out) {
+	const double rounding = 8.0 * (N + 2) *
+		(static_cast<double>(std::numeric_limits<T>::epsilon()) + std::numeric_limits<double>::epsilon());
+	const size_t k = means.size();
+	const std::pair<double, uint32_t>* row = &neighbours[guess * k];
+	const double to_guess = static_cast<double>(distance_squared(point, means[guess]));
+	const double reach = std::sqrt(to_guess) * (1.0 + rounding);
+	uint32_t count = 0;
+	for (size_t l = 0; l < k; ++l) {
+		// every mean further along is at least row[l].first - reach away from the point
+		if (count == c && (row[l].first * (1.0 - rounding) - reach) > std::sqrt(out[c - 1].first) * (1.0 + rounding)) {
+			break;
+		}
+		const uint32_t j = row[l].second;
+		const std::pair<double, uint32_t> candidate{
+			j == guess ? to_guess : static_cast<double>(distance_squared(point, means[j])), j};
+		if (count == c && !(candidate < out[c - 1])) {
+			continue;
+		}
+		uint32_t position = count < c ? count++ : c - 1;
+		while (position > 0 && candidate < out[position - 1]) {
+			out[position] = out[position - 1];
+			--position;
+		}
+		out[position] = candidate;
+	}
+}
+
+/*
+Size-constrained assignment of points to means, minimising the total squared distance, as a min-cost flow between
+the means solved with successive shortest paths.
+
+Points move along chains of moves, first out of the means holding more than `max_size` points into means with room
+to spare, then out of means with points to spare into those holding fewer than `min_size`; moving a point from mean
+a to mean b costs the increase in its squared distance. The graph of the search has only the k means as nodes, plus
+a source linked to the means that give points and a sink linked from those that take them, and the cheapest move
+between two means is kept in a heap per pair of means. Each Dijkstra, in O(k^2) on the costs reduced by the node
+potentials, finds a shortest chain, and points then move along it for as long as it stays shortest. Each chain
+keeps the assignment optimal for the current sizes, so the final one is optimal for both bounds.
+
+The potentials of the means are the prices of `prices`, which carry over between calls: every point starts at the
+mean minimising its squared distance less the price, rather than at its closest mean, so with the prices the last
+call left for nearby means the sizes start close to balanced and only a few chains are searched. When starting
+every point at its closest mean leaves the sizes closer to balanced, as after a large step of the means, the prices
+start from zero instead.
+
+Points can only move to one of their `candidates` closest means, so the result is optimal among the assignments
+that keep every point within its candidates; with candidates >= k it is the true optimum. When no chain exists
+under that restriction, the search starts over with candidate lists twice as long, and `candidates` is left at the
+length that sufficed so that the next call doesn't repeat the restarts. The candidates are found with nearest_means,
+searching from the point's label in `guesses` (e.g. those of the previous iteration, or empty), so with few
+candidates most of the k distances of a point are never computed.
+*/
+template <typename T, size_t N>
+std::vector<uint32_t> capacitated_assignment(const std::vector<std::array<T, N>>& data,
+	const std::vector<std::array<T, N>>& means,
+	size_t min_size,
+	size_t max_size,
+	uint32_t& candidates,
+	const std::vector<uint32_t>& guesses,
+	std::vector<double>& prices) {
+	typedef std::pair<double, size_t> transfer; // increase in squared distance, point
+	const size_t n = data.size();
+	const uint32_t k = static_cast<uint32_t>(means.size());
+	assert(prices.size() == k);
+	uint32_t c = std::min(candidates, k);
+
+	std::vector<std::pair<double, uint32_t>> nearest; // the c closest means of every point, closest first
+	const auto neighbours = mean_neighbours(means);
+	std::vector<uint32_t> labels(n);
+	std::vector<size_t> counts(k);
+
+	// heap of the moves from mean a to b at a * k + b
+	std::vector<std::vector<transfer>> moves(static_cast<size_t>(k) * k);
+	// nodes 0 .. k - 1 are the means, then the source and the sink
+	const uint32_t source = k, sink = k + 1;
+	std::vector<double> potential(k + 2);
+	auto move_order = [](const transfer& a, const transfer& b) { return a.first > b.first; };
+	auto add_moves = [&](size_t i) {
+		const std::pair<double, uint32_t>* list = &nearest[i * c];
+		double current = 0.0;
+		for (uint32_t l = 0; l < c; ++l) {
+			if (list[l].second == labels[i]) {
+				current = list[l].first;
+			}
+		}
+		for (uint32_t l = 0; l < c; ++l) {
+			if (list[l].second != labels[i]) {
+				auto& heap = moves[labels[i] * k + list[l].second];
+				heap.push_back({list[l].first - current, i});
+				std::push_heap(heap.begin(), heap.end(), move_order);
+			}
+		}
+	};
+	// start every point at the candidate with the smallest squared distance less potential, which makes the reduced
+	// costs of all moves non-negative, and count the points the sizes are off by
+	auto start = [&]() {
+		std::fill(counts.begin(), counts.end(), 0);
+		for (size_t i = 0; i < n; ++i) {
+			const std::pair<double, uint32_t>* list = &nearest[i * c];
+			uint32_t best = 0;
+			for (uint32_t l = 1; l < c; ++l) {
+				if (list[l].first - potential[list[l].second] < list[best].first - potential[list[best].second]) {
+					best = l;
+				}
+			}
+			labels[i] = list[best].second;
+			++counts[labels[i]];
+		}
+		size_t off = 0;
+		for (uint32_t j = 0; j < k; ++j) {
+			off += counts[j] > max_size ? counts[j] - max_size : counts[j] < min_size ? min_size - counts[j] : 0;
+		}
+		return off;
+	};
+	auto build = [&]() {
+		nearest.resize(static_cast<size_t>(n) * c);
+		for (size_t i = 0; i < n; ++i) {
+			nearest_means(data[i], means, neighbours, guesses.empty() ? 0 : guesses[i], c, &nearest[i * c]);
+		}
+		// the prices help once the means settle, but after a large step of the means none can be better
+		std::copy(prices.begin(), prices.end(), potential.begin());
+		size_t off = start();
+		if (off > 0) {
+			std::fill(potential.begin(), potential.begin() + k, 0.0);
+			if (start() > off) {
+				std::copy(prices.begin(), prices.end(), potential.begin());
+				start();
+			}
+		}
+		for (auto& heap : moves) {
+			heap.clear();
+		}
+		for (size_t i = 0; i < n; ++i) {
+			add_moves(i);
+		}
+	};
+	// cheapest move from mean a to b, dropping moves of points that have left a since
+	auto cheapest = [&](uint32_t a, uint32_t b) -> const transfer* {
+		auto& heap = moves[a * k + b];
+		while (!heap.empty() && labels[heap.front().second] != a) {
+			std::pop_heap(heap.begin(), heap.end(), move_order);
+			heap.pop_back();
+		}
+		return heap.empty() ? nullptr : &heap.front();
+	};
+
+	const double infinity = std::numeric_limits<double>::infinity();
+	std::vector<double> distance(k + 2);
+	std::vector<uint32_t> previous(k + 2), chain;
+	std::vector<char> done(k + 2);
+	// whether the means are being emptied down to max_size, or filled up to min_size
+	bool emptying = true;
+	auto gives = [&](uint32_t j) { return emptying ? counts[j] > max_size : counts[j] > min_size; };
+	auto takes = [&](uint32_t j) { return emptying ? counts[j] < max_size : counts[j] < min_size; };
+	auto unbalanced = [&]() {
+		for (uint32_t j = 0; j < k; ++j) {
+			if (emptying ? counts[j] > max_size : counts[j] < min_size) {
+				return true;
+			}
+		}
+		return false;
+	};
+	// the source and sink potentials at the start of a stage, which make the reduced costs of their arcs
+	// non-negative; the means that give and take points only get fewer during a stage
+	auto start_stage = [&]() {
+		potential[source] = *std::max_element(potential.begin(), potential.begin() + k);
+		potential[sink] = *std::min_element(potential.begin(), potential.begin() + k);
+	};
+	// reduced cost of the arc from node a to node b, infinite when there is none
+	auto reduced = [&](uint32_t a, uint32_t b) -> double {
+		if (a == source) {
+			return b < k && gives(b) ? potential[source] - potential[b] : infinity;
+		}
+		if (b == sink) {
+			return a < k && takes(a) ? potential[a] - potential[sink] : infinity;
+		}
+		if (a == sink || b == source || a == b) {
+			return infinity;
+		}
+		const transfer* m = cheapest(a, b);
+		return m ? m->first + potential[a] - potential[b] : infinity;
+	};
+	// move a point along every arc between means of the chain source, ..., sink, starting from the sink end so that
+	// no point moves twice
+	auto move_chain = [&]() {
+		for (size_t l = chain.size() - 2; l > 1; --l) {
+			size_t i = cheapest(chain[l - 1], chain[l])->second;
+			labels[i] = chain[l];
+			add_moves(i);
+		}
+		--counts[chain[1]];
+		++counts[chain[chain.size() - 2]];
+	};
+	// whether the chain is still shortest: its arcs have a reduced cost of zero, up to rounding
+	auto shortest = [&]() {
+		for (size_t l = 1; l < chain.size(); ++l) {
+			const uint32_t a = chain[l - 1], b = chain[l];
+			if (!(reduced(a, b) <= 1e-9 * (std::fabs(potential[a]) + std::fabs(potential[b])))) {
+				return false;
+			}
+		}
+		return true;
+	};
+	// one Dijkstra and the moves along the shortest chain it finds, false when there is no chain
+	auto phase = [&]() {
+		std::fill(distance.begin(), distance.end(), infinity);
+		std::fill(done.begin(), done.end(), 0);
+		distance[source] = 0.0;
+		for (;;) {
+			uint32_t a = sink + 1;
+			for (uint32_t v = 0; v <= sink; ++v) {
+				if (!done[v] && distance[v] < infinity && (a > sink || distance[v] < distance[a])) {
+					a = v;
+				}
+			}
+			if (a > sink) {
+				return false;
+			}
+			if (a == sink) {
+				break;
+			}
+			done[a] = 1;
+			for (uint32_t b = 0; b <= sink; ++b) {
+				double r = done[b] ? infinity : reduced(a, b);
+				if (r < infinity) {
+					// reduced costs are non-negative up to rounding
+					double d = distance[a] + std::max(r, 0.0);
+					if (d < distance[b]) {
+						distance[b] = d;
+						previous[b] = a;
+					}
+				}
+			}
+		}
+		for (uint32_t v = 0; v <= sink; ++v) {
+			potential[v] += std::min(distance[v], distance[sink]);
+		}
+		chain.assign(1, sink);
+		while (chain.back() != source) {
+			chain.push_back(previous[chain.back()]);
+		}
+		std::reverse(chain.begin(), chain.end());
+		// the first move is along a shortest chain by construction, the following ones while the moves next in
+		// line on every arc cost the same
+		do {
+			move_chain();
+		} while (shortest());
+		return true;
+	};
+
+	build();
+	start_stage();
+	for (;;) {
+		if (!unbalanced()) {
+			if (!emptying) {
+				break;
+			}
+			emptying = false;
+			start_stage();
+		} else if (!phase()) {
+			// start over, the optimum for the longer candidate lists can differ from the one found so far
+			assert(c < k);
+			c = std::min(2 * c, k);
+			build();
+			emptying = true;
+			start_stage();
+		}
+	}
+	candidates = c;
+	// only differences of prices matter, keep them small
+	const double lowest = *std::min_element(potential.begin(), potential.begin() + k);
+	for (uint32_t j = 0; j < k; ++j) {
+		prices[j] = potential[j] - lowest;
+	}
+	return labels;
+}
+
+} // namespace details
+
+
+/**
+ * Size-constrained k-means: every cluster ends up with between `min_size` and `max_size` points, e.g. to shard work
+ * evenly across workers.
+ *
+ * The assignment step of every Lloyd iteration solves the size-constrained assignment problem, both bounds at once,
+ * as a min-cost flow between the k means, moving points only to one of their `candidates` closest means. Each
+ * iteration starts from the cluster prices the previous one ended with, so once the means settle only a few points
+ * move and few shortest path searches, O(k^2) each, are needed. The candidates are searched outwards from the
+ * point's previous cluster, so with candidates well below k only the distances to the means around a point are
+ * computed. The means are updated with dkm::details::calculate_means.
+ *
+ * @param data       Points to be clustered.
+ * @param k          Number of clusters.
+ * @param min_size   Minimum number of points per cluster, k * min_size <= data.size().
+ * @param max_size   Maximum number of points per cluster, k * max_size >= data.size().
+ * @param maxIter    Maximum number of iterations.
+ * @param seed       Seed of the kmeans++ initialisation, -1 for a random seed.
+ * @param epsilon    Convergence threshold, as for dkm::kmeans_lloyd.
+ * @param candidates Number of closest means a point may be moved to, k for an exact assignment step.
+ *
+ * @return std::tuple of the cluster means and the cluster label of every point, as for dkm::kmeans_lloyd.
+ */
+template <typename T, size_t N>
+std::tuple<std::vector<std::array<T, N>>, std::vector<uint32_t>> kmeans_balanced(
+	const std::vector<std::array<T, N>>& data,
+	uint32_t k,
+	size_t min_size,
+	size_t max_size,
+	int maxIter,
+	int seed = -1,
+	float epsilon = 0.0f,
+	uint32_t candidates = 8) {
+	static_assert(std::is_arithmetic<T>::value && std::is_signed<T>::value,
+		"kmeans_balanced requires the template parameter T to be a signed arithmetic type (e.g. float, double, int)");
+	assert(k > 0);
+	assert(maxIter > 0);
+	assert(candidates > 0);
+	assert(min_size <= max_size);
+	assert(static_cast<size_t>(k) * min_size <= data.size()); // the minimum sizes must be achievable
+	assert(static_cast<size_t>(k) * max_size >= data.size()); // the maximum sizes must leave room for every point
+	std::vector<std::array<T, N>> means = details::random_plusplus(data, k, seed);
+
+	std::vector<std::array<T, N>> old_means;
+	std::vector<uint32_t> clusters;
+	std::vector<double> prices(k);
+	int count = 0;
+	do {
+		clusters = details::capacitated_assignment(data, means, min_size, max_size, candidates, clusters, prices);
+		old_means = means;
+		means = details::calculate_means(data, clusters, old_means, k);
+		++count;
+	} while (details::point_collection_epsilon(means, old_means) > epsilon && count < maxIter);
+
+	return std::tuple<std::vector<std::array<T, N>>, std::vector<uint32_t>>(means, clusters);
+}
+
+} // namespace dkm
@@ -0,0 +1,243 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstdint>
+#include <random>
+#include <tuple>
+#include <vector>
+
+#if defined(_MSC_VER) && defined(_M_X64) && (defined(DKM_HARDWARE_POPCOUNT) || defined(__AVX__))
+#define DKM_MSVC_POPCOUNT
+#include <intrin.h>
+#endif
+
+// Whether kmeans_majority can pick a POPCNT build of its assignment step at run time
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__)) && !defined(__POPCNT__)
+#define DKM_POPCOUNT_DISPATCH
+#endif
+
+#include "dkm.hpp"
+
+namespace dkm {
+
+namespace details {
+
+/*
+Number of set bits of a word. The POPCNT instruction is only used when the target is known to have it: with GCC and
+Clang when compiling for it (e.g. -mpopcnt or -march=native), with MSVC for /arch:AVX or when DKM_HARDWARE_POPCOUNT
+is defined. Otherwise the bits are counted with shifts and masks, which unlike the compilers' fallback is inlined.
+*/
+inline uint32_t popcount(uint64_t word) {
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__POPCNT__) || !(defined(__x86_64__) || defined(__i386__)))
+	return static_cast<uint32_t>(__builtin_popcountll(word));
+#elif defined(DKM_MSVC_POPCOUNT)
+	return static_cast<uint32_t>(__popcnt64(word));
+#else
+	word = word - ((word >> 1) & 0x5555555555555555ull);
+	word = (word & 0x3333333333333333ull) + ((word >> 2) & 0x3333333333333333ull);
+	word = (word + (word >> 4)) & 0x0f0f0f0f0f0f0f0full;
+	return static_cast<uint32_t>((word * 0x0101010101010101ull) >> 56);
+#endif
+}
+
+/*
+Hamming distance between two bit-packed descriptors.
+*/
+template <size_t W>
+uint32_t hamming_distance(const std::array<uint64_t, W>& a, const std::array<uint64_t, W>& b) {
+	uint32_t distance = 0;
+	for (size_t w = 0; w < W; ++w) {
+		distance += popcount(a[w] ^ b[w]);
+	}
+	return distance;
+}
+
+/*
+Index of the centroid with the smallest Hamming distance to a descriptor, the lowest index on ties.
+*/
+template <size_t W>
+uint32_t closest_centroid(const std::array<uint64_t, W>& point, const std::vector<std::array<uint64_t, W>>& centroids) {
+	assert(!centroids.empty());
+	uint32_t best = hamming_distance(point, centroids[0]);
+	uint32_t index = 0;
+	for (size_t j = 1; j < centroids.size(); ++j) {
+		uint32_t d = hamming_distance(point, centroids[j]);
+		if (d < best) {
+			best = d;
+			index = static_cast<uint32_t>(j);
+		}
+	}
+	return index;
+}
+
+/*
+Label every descriptor with closest_centroid, writing the labels to `labels` and returning whether any changed.
+*/
+template <size_t W>
+bool assign_centroids(const std::vector<std::array<uint64_t, W>>& data,
+	const std::vector<std::array<uint64_t, W>>& centroids,
+	std::vector<uint32_t>& labels) {
+	bool changed = false;
+	for (size_t i = 0; i < data.size(); ++i) {
+		uint32_t label = closest_centroid(data[i], centroids);
+		changed = changed || label != labels[i];
+		labels[i] = label;
+	}
+	return changed;
+}
+
+#ifdef DKM_POPCOUNT_DISPATCH
+
+/*
+assign_centroids compiled for CPUs with POPCNT, where __builtin_popcountll is a single instruction.
+*/
+template <size_t W>
+__attribute__((target("popcnt"))) bool assign_centroids_popcnt(const std::vector<std::array<uint64_t, W>>& data,
+	const std::vector<std::array<uint64_t, W>>& centroids,
+	std::vector<uint32_t>& labels) {
+	bool changed = false;
+	for (size_t i = 0; i < data.size(); ++i) {
+		uint32_t best = 0, label = 0;
+		for (size_t j = 0; j < centroids.size(); ++j) {
+			uint32_t d = 0;
+			for (size_t w = 0; w < W; ++w) {
+				d += static_cast<uint32_t>(__builtin_popcountll(data[i][w] ^ centroids[j][w]));
+			}
+			if (j == 0 || d < best) {
+				best = d;
+				label = static_cast<uint32_t>(j);
+			}
+		}
+		changed = changed || label != labels[i];
+		labels[i] = label;
+	}
+	return changed;
+}
+
+inline bool cpu_has_popcnt() {
+	static const bool supported = [] {
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("popcnt") != 0;
+	}();
+	return supported;
+}
+
+#endif
+
+} // namespace details
+
+
+/**
+ * Pack a byte array, e.g. a binary audio fingerprint, into 64-bit words for dkm::kmeans_majority. Byte b ends up
+ * in bits 8 (b % 8) .. 8 (b % 8) + 7 of word b / 8; missing bytes of the last word are zero.
+ */
+template <size_t W, size_t B>
+std::array<uint64_t, W> pack_bits(const std::array<uint8_t, B>& bytes) {
+	static_assert(B <= 8 * W, "pack_bits needs W words to hold at least B bytes");
+	std::array<uint64_t, W> words{};
+	for (size_t b = 0; b < B; ++b) {
+		words[b / 8] |= static_cast<uint64_t>(bytes[b]) << (8 * (b % 8));
+	}
+	return words;
+}
+
+/**
+ * k-majority clustering of binary descriptors of 64 W bits, e.g. audio fingerprints of 256 to 1024 bits.
+ *
+ * The k-means counterpart for the Hamming distance: points are assigned to the centroid with the fewest differing
+ * bits, computed with popcount on the packed words, and every bit of a centroid is set to the majority vote of that
+ * bit over the cluster's points, counted in one counter per bit. A tied vote keeps the centroid's previous bit, and
+ * an empty cluster keeps its centroid. The centroids are initialised with kmeans++ on the Hamming distance, and the
+ * iterations stop once no point changes cluster. With GCC and Clang on x86 the assignment step uses the POPCNT
+ * instruction when the CPU has it, even if the rest of the program is compiled without it.
+ *
+ * @param data     Bit-packed descriptors, see dkm::pack_bits.
+ * @param k        Number of clusters.
+ * @param maxIter  Maximum number of iterations.
+ * @param seed     Seed of the kmeans++ initialisation, -1 for a random seed.
+ *
+ * @return std::tuple of the centroids and the cluster label of every descriptor, as for dkm::kmeans_lloyd.
+ */
+template <size_t W>
+std::tuple<std::vector<std::array<uint64_t, W>>, std::vector<uint32_t>> kmeans_majority(
+	const std::vector<std::array<uint64_t, W>>& data, uint32_t k, int maxIter, int seed = -1) {
+	assert(k > 0);
+	assert(maxIter > 0);
+	assert(data.size() >= k);
+	std::linear_congruential_engine<uint64_t, 6364136223846793005, 1442695040888963407, UINT64_MAX> engine(
+		seed == -1 ? std::random_device()() : static_cast<uint32_t>(seed));
+	std::vector<std::array<uint64_t, W>> centroids;
+	{
+		std::uniform_int_distribution<size_t> uniform(0, data.size() - 1);
+		centroids.push_back(data[uniform(engine)]);
+	}
+	std::vector<uint32_t> closest(data.size());
+	for (size_t i = 0; i < data.size(); ++i) {
+		closest[i] = details::hamming_distance(data[i], centroids[0]);
+	}
+	std::vector<double> weights(data.size());
+	while (centroids.size() < k) {
+		double total = 0.0;
+		for (size_t i = 0; i < data.size(); ++i) {
+			weights[i] = static_cast<double>(closest[i]) * closest[i];
+			total += weights[i];
+		}
+		if (total == 0.0) {
+			// fewer distinct descriptors than clusters
+			std::fill(weights.begin(), weights.end(), 1.0);
+		}
+		std::discrete_distribution<size_t> generator(weights.begin(), weights.end());
+		centroids.push_back(data[generator(engine)]);
+		for (size_t i = 0; i < data.size(); ++i) {
+			closest[i] = std::min(closest[i], details::hamming_distance(data[i], centroids.back()));
+		}
+	}
+
+	std::vector<uint32_t> labels(data.size(), 0);
+	// votes[j * 64 W + b] counts the points of cluster j with bit b set
+	std::vector<uint32_t> votes(static_cast<size_t>(k) * 64 * W);
+	std::vector<uint32_t> sizes(k);
+	for (int iteration = 0; iteration < maxIter; ++iteration) {
+#ifdef DKM_POPCOUNT_DISPATCH
+		bool changed = details::cpu_has_popcnt() ? details::assign_centroids_popcnt(data, centroids, labels)
+												 : details::assign_centroids(data, centroids, labels);
+#else
+		bool changed = details::assign_centroids(data, centroids, labels);
+#endif
+		if (!changed && iteration > 0) {
+			break;
+		}
+		std::fill(votes.begin(), votes.end(), 0);
+		std::fill(sizes.begin(), sizes.end(), 0);
+		for (size_t i = 0; i < data.size(); ++i) {
+			uint32_t* counter = &votes[labels[i] * 64 * W];
+			for (size_t w = 0; w < W; ++w) {
+				const uint64_t word = data[i][w];
+				for (size_t b = 0; b < 64; ++b) {
+					counter[w * 64 + b] += static_cast<uint32_t>((word >> b) & 1);
+				}
+			}
+			++sizes[labels[i]];
+		}
+		for (uint32_t j = 0; j < k; ++j) {
+			const uint32_t* counter = &votes[j * 64 * W];
+			for (size_t w = 0; w < W; ++w) {
+				uint64_t word = centroids[j][w];
+				for (size_t b = 0; b < 64; ++b) {
+					const uint32_t twice = 2 * counter[w * 64 + b];
+					if (twice > sizes[j]) {
+						word |= uint64_t(1) << b;
+					} else if (twice < sizes[j]) {
+						word &= ~(uint64_t(1) << b);
+					}
+				}
+				centroids[j][w] = word;
+			}
+		}
+	}
+	return std::tuple<std::vector<std::array<uint64_t, W>>, std::vector<uint32_t>>(centroids, labels);
+}
+
+} // namespace dkm
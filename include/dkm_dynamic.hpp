@@ -0,0 +1,346 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+#include "dkm.hpp"
+
+namespace dkm {
+
+/**
+ * k-means over a data set that changes by individual insertions and deletions, e.g. a sample library that users
+ * add sounds to and delete sounds from.
+ *
+ * Every point gets an id when it's inserted, which stays valid until the point is erased; ids of erased points are
+ * reused. Cluster sums and counts are kept up to date, so inserting a point costs O(k N) to find its closest mean
+ * and erasing one O(N), and the means always reflect the current points. After every batch of insertions or
+ * deletions a few local Lloyd passes reassign the points that a moved mean may have become closest to, instead of
+ * the whole data set: all points of the clusters whose mean moved, and the points of other clusters that lie
+ * further from their own mean than half its distance to a moved mean. Every cluster keeps an upper bound on the
+ * distance of its points from its mean, so clusters well away from the moved means are skipped whole. Once a
+ * refinement stops because no mean moved, every point is labelled with its closest mean, as in an iteration of
+ * dkm::kmeans_lloyd on the same means.
+ *
+ * The data set is clustered with dkm::kmeans_lloyd once it holds k points.
+ */
+template <typename T, size_t N>
+class dynamic_kmeans {
+	static_assert(std::is_floating_point<T>::value,
+		"dynamic_kmeans requires the template parameter T to be a floating point type (float, double)");
+
+public:
+	/**
+	 * @param k        Number of clusters.
+	 * @param max_iter Maximum number of Lloyd iterations of the initial clustering.
+	 * @param passes   Number of local refinement passes after every insert or erase.
+	 * @param seed     Seed of the kmeans++ initialisation, -1 for a random seed.
+	 */
+	dynamic_kmeans(uint32_t k, int max_iter = 100, int passes = 2, int seed = -1)
+		: k_(k), max_iter_(max_iter), passes_(passes), seed_(seed), size_(0) {
+		rounding_ = 8.0 * (N + 2) *
+			(static_cast<double>(std::numeric_limits<T>::epsilon()) + std::numeric_limits<double>::epsilon());
+		assert(k > 0);
+		assert(max_iter > 0);
+		assert(passes >= 0);
+	}
+
+	/**
+	 * Add points and update the clustering.
+	 *
+	 * @return The id of every point, in the order given.
+	 */
+	std::vector<size_t> insert(const std::vector<std::array<T, N>>& points) {
+		std::vector<size_t> ids;
+		ids.reserve(points.size());
+		for (auto& p : points) {
+			size_t id;
+			if (free_.empty()) {
+				id = entries_.size();
+				entries_.push_back(entry());
+			} else {
+				id = free_.back();
+				free_.pop_back();
+			}
+			auto& e = entries_[id];
+			e.point = p;
+			e.label = unassigned;
+			e.alive = true;
+			++size_;
+			if (!means_.empty()) {
+				add(id, details::closest_mean(p, means_));
+			}
+			ids.push_back(id);
+		}
+		if (means_.empty()) {
+			if (size_ < k_) {
+				return ids;
+			}
+			initialize();
+		} else {
+			update_means();
+		}
+		refine(passes_);
+		return ids;
+	}
+
+	/**
+	 * Remove points and update the clustering. Clusters that lose all their points keep their last mean.
+	 *
+	 * @param ids Ids returned by insert() of points that haven't been erased yet.
+	 */
+	void erase(const std::vector<size_t>& ids) {
+		for (auto id : ids) {
+			assert(contains(id));
+			auto& e = entries_[id];
+			if (e.label != unassigned) {
+				remove(id);
+			}
+			e.alive = false;
+			free_.push_back(id);
+			--size_;
+		}
+		if (!means_.empty()) {
+			update_means();
+			refine(passes_);
+		}
+	}
+
+	/**
+	 * Run up to `passes` local Lloyd passes, each reassigning the points a mean that moved since the previous pass
+	 * may now be closest to. Stops early once no mean moves, leaving every point labelled with its closest mean.
+	 */
+	void refine(int passes) {
+		for (int pass = 0; pass < passes; ++pass) {
+			std::vector<uint32_t> moved;
+			for (uint32_t j = 0; j < k_; ++j) {
+				if (moved_[j]) {
+					moved.push_back(j);
+				}
+			}
+			if (moved.empty()) {
+				return;
+			}
+			std::fill(moved_.begin(), moved_.end(), false);
+			// a point closer to its own mean than half the distance from there to every moved mean stays; the
+			// clusters that moved themselves have a reach of zero
+			std::vector<double> reach(k_, std::numeric_limits<double>::infinity());
+			for (uint32_t c = 0; c < k_; ++c) {
+				for (auto j : moved) {
+					reach[c] = std::min(reach[c], 0.5 * distance(means_[c], means_[j]) * (1.0 - rounding_));
+				}
+			}
+			std::vector<uint32_t> clusters;
+			for (uint32_t c = 0; c < k_; ++c) {
+				if (!(radius_[c] < reach[c])) {
+					clusters.push_back(c);
+					// measured again below, and grown by the points that move in
+					radius_[c] = 0.0;
+				}
+			}
+			for (auto c : clusters) {
+				// copied as points moving out of the cluster change the member list
+				auto ids = members_[c];
+				for (auto id : ids) {
+					if (entries_[id].label != c) {
+						continue;
+					}
+					const double d = distance(entries_[id].point, means_[c]) * (1.0 + rounding_);
+					if (d < reach[c]) {
+						radius_[c] = std::max(radius_[c], d);
+					} else {
+						reassign(id);
+					}
+				}
+			}
+			update_means();
+		}
+	}
+
+	/**
+	 * Reassign every point once, like an iteration of dkm::kmeans_lloyd.
+	 */
+	void refine_all() {
+		std::fill(radius_.begin(), radius_.end(), 0.0);
+		for (size_t id = 0; id < entries_.size(); ++id) {
+			if (entries_[id].alive && entries_[id].label != unassigned) {
+				reassign(id);
+			}
+		}
+		update_means();
+	}
+
+	/**
+	 * Current cluster means, empty until the data set held k points.
+	 */
+	const std::vector<std::array<T, N>>& means() const { return means_; }
+
+	/**
+	 * Cluster label of a point, only valid once the means exist.
+	 */
+	uint32_t label(size_t id) const {
+		assert(contains(id));
+		return entries_[id].label;
+	}
+
+	/**
+	 * The point with the given id.
+	 */
+	const std::array<T, N>& point(size_t id) const {
+		assert(contains(id));
+		return entries_[id].point;
+	}
+
+	/**
+	 * Ids of the points in a cluster, in no particular order.
+	 */
+	const std::vector<size_t>& members(uint32_t cluster) const { return members_[cluster]; }
+
+	/**
+	 * Whether `id` belongs to a point that hasn't been erased.
+	 */
+	bool contains(size_t id) const { return id < entries_.size() && entries_[id].alive; }
+
+	/**
+	 * Number of points in the data set.
+	 */
+	size_t size() const { return size_; }
+
+private:
+	static const uint32_t unassigned = std::numeric_limits<uint32_t>::max();
+
+	struct entry {
+		std::array<T, N> point;
+		uint32_t label;
+		// index of the point in members_[label]
+		size_t position;
+		bool alive;
+	};
+
+	void add(size_t id, uint32_t label) {
+		auto& e = entries_[id];
+		e.label = label;
+		e.position = members_[label].size();
+		members_[label].push_back(id);
+		radius_[label] = std::max(radius_[label], distance(e.point, means_[label]) * (1.0 + rounding_));
+		auto& sum = sums_[label];
+		for (size_t i = 0; i < N; ++i) {
+			sum[i] += e.point[i];
+		}
+		changed_[label] = true;
+	}
+
+	void remove(size_t id) {
+		auto& e = entries_[id];
+		auto& members = members_[e.label];
+		entries_[members.back()].position = e.position;
+		members[e.position] = members.back();
+		members.pop_back();
+		auto& sum = sums_[e.label];
+		for (size_t i = 0; i < N; ++i) {
+			sum[i] -= e.point[i];
+		}
+		changed_[e.label] = true;
+		e.label = unassigned;
+	}
+
+	void reassign(size_t id) {
+		uint32_t label = details::closest_mean(entries_[id].point, means_);
+		if (label != entries_[id].label) {
+			remove(id);
+			add(id, label);
+		} else {
+			radius_[label] = std::max(radius_[label], distance(entries_[id].point, means_[label]) * (1.0 + rounding_));
+		}
+	}
+
+	static double distance(const std::array<T, N>& a, const std::array<T, N>& b) {
+		double sum = 0.0;
+		for (size_t i = 0; i < N; ++i) {
+			double delta = static_cast<double>(a[i]) - static_cast<double>(b[i]);
+			sum += delta * delta;
+		}
+		return std::sqrt(sum);
+	}
+
+	void initialize() {
+		std::vector<std::array<T, N>> data;
+		std::vector<size_t> ids;
+		data.reserve(size_);
+		ids.reserve(size_);
+		for (size_t id = 0; id < entries_.size(); ++id) {
+			if (entries_[id].alive) {
+				data.push_back(entries_[id].point);
+				ids.push_back(id);
+			}
+		}
+		auto result = kmeans_lloyd(data, k_, max_iter_, seed_);
+		means_ = std::get<0>(result);
+		members_.assign(k_, std::vector<size_t>());
+		sums_.assign(k_, std::array<double, N>());
+		changed_.assign(k_, false);
+		radius_.assign(k_, 0.0);
+		for (size_t i = 0; i < ids.size(); ++i) {
+			add(ids[i], std::get<1>(result)[i]);
+		}
+		// kmeans_lloyd's labels belong to the means before its last update, so every point is checked again
+		moved_.assign(k_, true);
+		update_means();
+	}
+
+	/*
+	Recalculate the means of the clusters that gained or lost points from their sums and mark the ones that moved.
+	Empty clusters keep their previous mean.
+	*/
+	void update_means() {
+		for (uint32_t j = 0; j < k_; ++j) {
+			if (!changed_[j]) {
+				continue;
+			}
+			changed_[j] = false;
+			if (members_[j].empty()) {
+				// start again from zero, rather than from the rounding error left by the subtractions
+				sums_[j] = std::array<double, N>();
+				continue;
+			}
+			std::array<T, N> mean;
+			for (size_t i = 0; i < N; ++i) {
+				mean[i] = static_cast<T>(sums_[j][i] / static_cast<double>(members_[j].size()));
+			}
+			if (mean != means_[j]) {
+				radius_[j] = (radius_[j] + distance(mean, means_[j]) * (1.0 + rounding_)) * (1.0 + rounding_);
+				means_[j] = mean;
+				moved_[j] = true;
+			}
+		}
+	}
+
+	uint32_t k_;
+	int max_iter_;
+	int passes_;
+	int seed_;
+	size_t size_;
+	std::vector<entry> entries_;
+	// ids of erased points, reused by insert()
+	std::vector<size_t> free_;
+	std::vector<std::array<T, N>> means_;
+	std::vector<std::vector<size_t>> members_;
+	// sums are kept in double precision as they are updated incrementally over all edits
+	std::vector<std::array<double, N>> sums_;
+	// clusters that gained or lost points since their mean was last calculated
+	std::vector<bool> changed_;
+	// clusters whose mean moved since the last refinement pass
+	std::vector<bool> moved_;
+	// upper bound on the distance of every cluster's points from its mean
+	std::vector<double> radius_;
+	// relative margin for the rounding of distances, as in details::bounded_assignment
+	double rounding_;
+};
+
+} // namespace dkm
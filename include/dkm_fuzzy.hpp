@@ -0,0 +1,178 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+#include "dkm.hpp"
+
+namespace dkm {
+
+namespace details {
+
+// Number of points whose distances and memberships are computed together
+const size_t fuzzy_block_size = 256;
+
+/*
+Turn the squared distances of one point to all k centroids into fuzzy memberships, in place.
+
+The membership of centroid j is u_j = w_j / sum(w) with w_j = (d_min / d_j)^(1/(m - 1)), which takes k logarithms
+and exponentials per point rather than the k^2 powers of the textbook ratio formula, and none at all for the common
+m = 2. Dividing by the smallest distance d_min makes the largest weight 1, so the sum can't underflow to 0 when m is
+close to 1 or the distances are large; weights that underflow are memberships too small to represent. A point lying
+exactly on a centroid belongs to that centroid only.
+*/
+inline void fuzzy_memberships_from_distances(double* d, uint32_t k, double m) {
+	const double smallest = *std::min_element(d, d + k);
+	if (smallest == 0.0) {
+		const uint32_t on = static_cast<uint32_t>(std::find(d, d + k, 0.0) - d);
+		std::fill(d, d + k, 0.0);
+		d[on] = 1.0;
+		return;
+	}
+	double total = 0.0;
+	if (m == 2.0) {
+		for (uint32_t j = 0; j < k; ++j) {
+			d[j] = smallest / d[j];
+			total += d[j];
+		}
+	} else {
+		const double exponent = 1.0 / (m - 1.0);
+		const double log_smallest = std::log(smallest);
+		for (uint32_t j = 0; j < k; ++j) {
+			d[j] = std::exp(exponent * (log_smallest - std::log(d[j])));
+			total += d[j];
+		}
+	}
+	const double scale = 1.0 / total;
+	for (uint32_t j = 0; j < k; ++j) {
+		d[j] *= scale;
+	}
+}
+
+/*
+Calculate the squared distances of the points [first, first + count) to every centroid into `block` (row-major,
+count x k) and convert each row into memberships.
+*/
+template <typename T, size_t N>
+void fuzzy_membership_block(const std::vector<std::array<T, N>>& data,
+	const std::vector<std::array<T, N>>& centroids,
+	size_t first,
+	size_t count,
+	double m,
+	std::vector<double>& block) {
+	const uint32_t k = static_cast<uint32_t>(centroids.size());
+	for (size_t i = 0; i < count; ++i) {
+		double* row = &block[i * k];
+		for (uint32_t j = 0; j < k; ++j) {
+			row[j] = static_cast<double>(distance_squared(data[first + i], centroids[j]));
+		}
+		fuzzy_memberships_from_distances(row, k, m);
+	}
+}
+
+} // namespace details
+
+
+/**
+ * Calculates the fuzzy membership of every point in every cluster for the given centroids.
+ *
+ * @param points    Sequence of points.
+ * @param centroids Cluster centroids, e.g. as returned by dkm::fuzzy_cmeans.
+ * @param m         Fuzzifier, greater than 1. Values close to 1 give almost hard memberships.
+ *
+ * @return Row-major points.size() x centroids.size() matrix of memberships, every row summing to 1.
+ */
+template <typename T, size_t N>
+std::vector<T> fuzzy_memberships(
+	const std::vector<std::array<T, N>>& points, const std::vector<std::array<T, N>>& centroids, double m) {
+	assert(m > 1.0);
+	assert(!centroids.empty());
+	const size_t k = centroids.size();
+	std::vector<T> memberships(points.size() * k);
+	std::vector<double> block(details::fuzzy_block_size * k);
+	for (size_t first = 0; first < points.size(); first += details::fuzzy_block_size) {
+		size_t count = std::min(details::fuzzy_block_size, points.size() - first);
+		details::fuzzy_membership_block(points, centroids, first, count, m, block);
+		std::transform(block.begin(), block.begin() + count * k, memberships.begin() + first * k, [](double u) {
+			return static_cast<T>(u);
+		});
+	}
+	return memberships;
+}
+
+/**
+ * Fuzzy c-means (soft k-means) clustering.
+ *
+ * Every point belongs to every cluster with a membership u between 0 and 1, and every centroid is the average of
+ * all points weighted by u^m. The membership and weighted-sum passes are fused: memberships are calculated for a
+ * block of points at a time and immediately accumulated into the centroid sums, so memory use is independent of
+ * the number of points. Use dkm::fuzzy_memberships to obtain the memberships for the returned centroids.
+ *
+ * The centroids are initialised with kmeans++, like dkm::kmeans_lloyd.
+ *
+ * @param data     Points to be clustered.
+ * @param k        Number of clusters.
+ * @param m        Fuzzifier, greater than 1. m = 2 is the usual choice and the fastest.
+ * @param maxIter  Maximum number of iterations.
+ * @param seed     Seed of the kmeans++ initialisation, -1 for a random seed.
+ * @param epsilon  Iterations stop once dkm::details::point_collection_epsilon of two successive sets of centroids
+ *                 is no larger than epsilon.
+ *
+ * @return The k cluster centroids.
+ */
+template <typename T, size_t N>
+std::vector<std::array<T, N>> fuzzy_cmeans(const std::vector<std::array<T, N>>& data,
+	uint32_t k,
+	double m,
+	int maxIter,
+	int seed = -1,
+	float epsilon = 0.0f) {
+	static_assert(std::is_floating_point<T>::value,
+		"fuzzy_cmeans requires the template parameter T to be a floating point type (float, double)");
+	assert(k > 0);
+	assert(m > 1.0);
+	assert(maxIter > 0);
+	assert(data.size() >= k);
+	std::vector<std::array<T, N>> centroids = details::random_plusplus(data, k, seed);
+	std::vector<std::array<T, N>> old_centroids;
+	std::vector<double> block(details::fuzzy_block_size * k);
+	std::vector<std::array<double, N>> sums(k);
+	std::vector<double> weights(k);
+	int count = 0;
+	do {
+		std::fill(sums.begin(), sums.end(), std::array<double, N>());
+		std::fill(weights.begin(), weights.end(), 0.0);
+		for (size_t first = 0; first < data.size(); first += details::fuzzy_block_size) {
+			size_t points = std::min(details::fuzzy_block_size, data.size() - first);
+			details::fuzzy_membership_block(data, centroids, first, points, m, block);
+			for (size_t i = 0; i < points; ++i) {
+				auto& point = data[first + i];
+				for (uint32_t j = 0; j < k; ++j) {
+					double u = block[i * k + j];
+					double w = m == 2.0 ? u * u : std::pow(u, m);
+					weights[j] += w;
+					for (size_t d = 0; d < N; ++d) {
+						sums[j][d] += w * static_cast<double>(point[d]);
+					}
+				}
+			}
+		}
+		old_centroids = centroids;
+		for (uint32_t j = 0; j < k; ++j) {
+			if (weights[j] > 0.0) {
+				for (size_t d = 0; d < N; ++d) {
+					centroids[j][d] = static_cast<T>(sums[j][d] / weights[j]);
+				}
+			}
+		}
+		++count;
+	} while (details::point_collection_epsilon(centroids, old_centroids) > epsilon && count < maxIter);
+	return centroids;
+}
+
+} // namespace dkm
@@ -0,0 +1,255 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+#include "dkm.hpp"
+#include "dkm_parallel.hpp"
+
+namespace dkm {
+
+/**
+ * Gaussian mixture model with diagonal covariances.
+ */
+template <typename T, size_t N>
+struct gmm_diag {
+	// mixing weight of each component, summing to 1
+	std::vector<T> weights;
+	// mean of each component
+	std::vector<std::array<T, N>> means;
+	// per-dimension variance of each component
+	std::vector<std::array<T, N>> variances;
+	// average log-likelihood of the training points under the model of the last E-step
+	double log_likelihood;
+	// number of EM iterations run
+	int iterations;
+};
+
+namespace details {
+
+// Number of points whose component log-densities are computed together in the E-step
+const size_t gmm_block_size = 256;
+
+/*
+Sufficient statistics of one thread's share of the data: sum of responsibilities and of responsibility-weighted
+values and squares per component, and the sum of the points' log-likelihoods.
+*/
+template <size_t N>
+struct gmm_statistics {
+	std::vector<double> responsibility;
+	std::vector<std::array<double, N>> first;
+	std::vector<std::array<double, N>> second;
+	double log_likelihood;
+
+	void reset(size_t k) {
+		responsibility.assign(k, 0.0);
+		first.assign(k, std::array<double, N>());
+		second.assign(k, std::array<double, N>());
+		log_likelihood = 0.0;
+	}
+
+	void add(const gmm_statistics& other) {
+		for (size_t j = 0; j < responsibility.size(); ++j) {
+			responsibility[j] += other.responsibility[j];
+			for (size_t d = 0; d < N; ++d) {
+				first[j][d] += other.first[j][d];
+				second[j][d] += other.second[j][d];
+			}
+		}
+		log_likelihood += other.log_likelihood;
+	}
+};
+
+/*
+Fused E-step and M-step accumulation over the points [first, last): the log-densities of a block of points are
+computed for every component, normalised with log-sum-exp and immediately accumulated into `stats`. `log_norm`
+holds log(weight) - 0.5 * sum(log(2 pi variance)) of each component and `inv_var` the inverse variances.
+*/
+template <typename T, size_t N>
+void gmm_accumulate(const std::vector<std::array<T, N>>& data,
+	size_t first,
+	size_t last,
+	const std::vector<std::array<double, N>>& means,
+	const std::vector<std::array<double, N>>& inv_var,
+	const std::vector<double>& log_norm,
+	std::vector<double>& block,
+	gmm_statistics<N>& stats) {
+	const size_t k = means.size();
+	for (size_t start = first; start < last; start += gmm_block_size) {
+		size_t count = std::min(gmm_block_size, last - start);
+		for (size_t i = 0; i < count; ++i) {
+			auto& point = data[start + i];
+			double* row = &block[i * k];
+			for (size_t j = 0; j < k; ++j) {
+				double mahalanobis = 0.0;
+				for (size_t d = 0; d < N; ++d) {
+					double delta = static_cast<double>(point[d]) - means[j][d];
+					mahalanobis += delta * delta * inv_var[j][d];
+				}
+				row[j] = log_norm[j] - 0.5 * mahalanobis;
+			}
+		}
+		for (size_t i = 0; i < count; ++i) {
+			auto& point = data[start + i];
+			double* row = &block[i * k];
+			double largest = *std::max_element(row, row + k);
+			double total = 0.0;
+			for (size_t j = 0; j < k; ++j) {
+				row[j] = std::exp(row[j] - largest);
+				total += row[j];
+			}
+			stats.log_likelihood += largest + std::log(total);
+			double scale = 1.0 / total;
+			for (size_t j = 0; j < k; ++j) {
+				double r = row[j] * scale;
+				stats.responsibility[j] += r;
+				for (size_t d = 0; d < N; ++d) {
+					double x = static_cast<double>(point[d]);
+					stats.first[j][d] += r * x;
+					stats.second[j][d] += r * x * x;
+				}
+			}
+		}
+	}
+}
+
+} // namespace details
+
+
+/**
+ * Fit a Gaussian mixture model with diagonal covariances using expectation maximisation, initialised from a
+ * k-means clustering of the same data.
+ *
+ * Each component starts with the mean, the fraction of points and the per-dimension variance of one k-means
+ * cluster. Every EM iteration makes a single pass over the data: the E-step computes the component log-densities
+ * a block of points at a time, normalises them with log-sum-exp and directly accumulates the sufficient statistics
+ * of the M-step. The pass is split over threads, each with its own statistics. The threads and all buffers are
+ * created before the first iteration, and each iteration only wakes the threads and waits for them.
+ *
+ * @param data       Points that were clustered.
+ * @param clustering Result of dkm::kmeans_lloyd (or any other clustering) of `data`.
+ * @param maxIter    Maximum number of EM iterations.
+ * @param tolerance  Iterations stop once the average log-likelihood improves by less than this.
+ * @param reg_covar  Added to every variance to keep components from collapsing onto single points.
+ * @param threads    Number of threads, 0 for one per hardware thread.
+ *
+ * @return The fitted model.
+ */
+template <typename T, size_t N>
+gmm_diag<T, N> fit_gmm_diag(const std::vector<std::array<T, N>>& data,
+	const std::tuple<std::vector<std::array<T, N>>, std::vector<uint32_t>>& clustering,
+	int maxIter,
+	double tolerance = 1e-6,
+	double reg_covar = 1e-6,
+	unsigned threads = 0) {
+	static_assert(std::is_floating_point<T>::value,
+		"fit_gmm_diag requires the template parameter T to be a floating point type (float, double)");
+	const auto& centroids = std::get<0>(clustering);
+	const auto& labels = std::get<1>(clustering);
+	const size_t k = centroids.size();
+	assert(k > 0);
+	assert(maxIter > 0);
+	assert(labels.size() == data.size() && !data.empty());
+	const double n = static_cast<double>(data.size());
+	const double log_2pi = std::log(2.0 * 3.14159265358979323846);
+
+	// statistics of the k-means clusters, and of all data for clusters that ended up empty
+	details::gmm_statistics<N> stats;
+	stats.reset(k);
+	std::array<double, N> global_mean{}, global_var{};
+	for (size_t i = 0; i < data.size(); ++i) {
+		auto j = labels[i];
+		stats.responsibility[j] += 1.0;
+		for (size_t d = 0; d < N; ++d) {
+			double x = static_cast<double>(data[i][d]);
+			double delta = x - static_cast<double>(centroids[j][d]);
+			stats.second[j][d] += delta * delta;
+			global_mean[d] += x;
+			global_var[d] += x * x;
+		}
+	}
+	for (size_t d = 0; d < N; ++d) {
+		global_mean[d] /= n;
+		global_var[d] = std::max(global_var[d] / n - global_mean[d] * global_mean[d], 0.0);
+	}
+
+	std::vector<double> weights(k), log_norm(k);
+	std::vector<std::array<double, N>> means(k), variances(k), inv_var(k);
+	for (size_t j = 0; j < k; ++j) {
+		double count = stats.responsibility[j];
+		weights[j] = std::max(count, 1.0) / n;
+		for (size_t d = 0; d < N; ++d) {
+			means[j][d] = static_cast<double>(centroids[j][d]);
+			variances[j][d] = (count > 0.0 ? stats.second[j][d] / count : global_var[d]) + reg_covar;
+		}
+	}
+
+	const unsigned thread_count = details::thread_count(threads, data.size());
+	std::vector<details::gmm_statistics<N>> partial(thread_count);
+	std::vector<std::vector<double>> blocks(thread_count, std::vector<double>(details::gmm_block_size * k));
+	for (auto& p : partial) {
+		p.reset(k);
+	}
+	details::worker_pool pool(thread_count);
+
+	gmm_diag<T, N> model;
+	model.log_likelihood = -std::numeric_limits<double>::infinity();
+	model.iterations = 0;
+	while (model.iterations < maxIter) {
+		for (size_t j = 0; j < k; ++j) {
+			log_norm[j] = std::log(weights[j]);
+			for (size_t d = 0; d < N; ++d) {
+				log_norm[j] -= 0.5 * (log_2pi + std::log(variances[j][d]));
+				inv_var[j][d] = 1.0 / variances[j][d];
+			}
+		}
+		pool.run(data.size(), [&](unsigned t, size_t first, size_t last) {
+			partial[t].reset(k);
+			details::gmm_accumulate(data, first, last, means, inv_var, log_norm, blocks[t], partial[t]);
+		});
+		stats.reset(k);
+		for (auto& p : partial) {
+			stats.add(p);
+		}
+
+		for (size_t j = 0; j < k; ++j) {
+			double r = stats.responsibility[j];
+			if (r <= 0.0) {
+				continue;
+			}
+			weights[j] = r / n;
+			for (size_t d = 0; d < N; ++d) {
+				means[j][d] = stats.first[j][d] / r;
+				variances[j][d] = std::max(stats.second[j][d] / r - means[j][d] * means[j][d], 0.0) + reg_covar;
+			}
+		}
+		++model.iterations;
+		double log_likelihood = stats.log_likelihood / n;
+		bool converged = log_likelihood - model.log_likelihood < tolerance;
+		model.log_likelihood = log_likelihood;
+		if (converged) {
+			break;
+		}
+	}
+
+	model.weights.resize(k);
+	model.means.resize(k);
+	model.variances.resize(k);
+	for (size_t j = 0; j < k; ++j) {
+		model.weights[j] = static_cast<T>(weights[j]);
+		for (size_t d = 0; d < N; ++d) {
+			model.means[j][d] = static_cast<T>(means[j][d]);
+			model.variances[j][d] = static_cast<T>(variances[j][d]);
+		}
+	}
+	return model;
+}
+
+} // namespace dkm
@@ -0,0 +1,257 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+#include "dkm.hpp"
+
+namespace dkm {
+
+namespace details {
+
+/*
+Points binned into a uniform grid over their bounding box. The points are stored cell by cell, and every occupied
+cell keeps the number and the sum of its points and the bounding box of just its points.
+*/
+template <typename T, size_t N>
+class point_grid {
+public:
+	struct cell {
+		size_t first;
+		size_t last;
+		std::array<double, N> sum;
+		std::array<double, N> low;
+		std::array<double, N> high;
+	};
+
+	point_grid(const std::vector<std::array<T, N>>& data, size_t points_per_cell) {
+		assert(!data.empty());
+		std::array<double, N> low, high;
+		low.fill(std::numeric_limits<double>::max());
+		high.fill(std::numeric_limits<double>::lowest());
+		for (auto& point : data) {
+			for (size_t d = 0; d < N; ++d) {
+				low[d] = std::min(low[d], static_cast<double>(point[d]));
+				high[d] = std::max(high[d], static_cast<double>(point[d]));
+			}
+		}
+		const double cells = std::max(1.0, static_cast<double>(data.size()) / std::max<size_t>(points_per_cell, 1));
+		const size_t side =
+			std::max<size_t>(1, static_cast<size_t>(std::pow(cells, 1.0 / static_cast<double>(N)) + 0.5));
+		std::array<double, N> scale;
+		size_t total = 1;
+		for (size_t d = 0; d < N; ++d) {
+			scale[d] = high[d] > low[d] ? static_cast<double>(side) / (high[d] - low[d]) : 0.0;
+			total *= side;
+		}
+
+		// counting sort of the points by cell
+		std::vector<size_t> keys(data.size());
+		std::vector<size_t> starts(total + 1, 0);
+		for (size_t i = 0; i < data.size(); ++i) {
+			size_t key = 0;
+			for (size_t d = N; d-- > 0;) {
+				double c = (static_cast<double>(data[i][d]) - low[d]) * scale[d];
+				key = key * side + std::min(static_cast<size_t>(std::max(c, 0.0)), side - 1);
+			}
+			keys[i] = key;
+			++starts[key + 1];
+		}
+		for (size_t c = 0; c < total; ++c) {
+			starts[c + 1] += starts[c];
+		}
+		points_.resize(data.size());
+		index_.resize(data.size());
+		for (size_t i = 0; i < data.size(); ++i) {
+			size_t position = starts[keys[i]]++;
+			points_[position] = data[i];
+			index_[position] = i;
+		}
+
+		size_t first = 0;
+		for (size_t c = 0; c < total; ++c) {
+			const size_t last = starts[c];
+			if (last == first) {
+				continue;
+			}
+			cell box{first, last, std::array<double, N>(), low, low};
+			box.low.fill(std::numeric_limits<double>::max());
+			box.high.fill(std::numeric_limits<double>::lowest());
+			for (size_t i = first; i < last; ++i) {
+				for (size_t d = 0; d < N; ++d) {
+					const double x = static_cast<double>(points_[i][d]);
+					box.sum[d] += x;
+					box.low[d] = std::min(box.low[d], x);
+					box.high[d] = std::max(box.high[d], x);
+				}
+			}
+			cells_.push_back(box);
+			first = last;
+		}
+	}
+
+	const std::vector<cell>& cells() const { return cells_; }
+	// the points, cell by cell
+	const std::vector<std::array<T, N>>& points() const { return points_; }
+	// position of every point of points() in the original data
+	const std::vector<size_t>& index() const { return index_; }
+
+private:
+	std::vector<std::array<T, N>> points_;
+	std::vector<size_t> index_;
+	std::vector<cell> cells_;
+};
+
+} // namespace details
+
+
+/**
+ * k-means of 2-D or 3-D data with millions of points, e.g. spectral peak maps or positions of sound sources, that
+ * runs Lloyd iterations over the occupied cells of a grid instead of over the points.
+ *
+ * The points are binned once into a uniform grid of about `points_per_cell` points per cell, and every cell keeps
+ * the sum and the bounding box of its points. In each iteration a cell whose box lies entirely on one mean's side
+ * of every boundary between means (checked at the box's corners, with a margin for rounding) moves all its points
+ * at once by adding its sum to that mean; only the points of cells that straddle a boundary are assigned one by
+ * one. An iteration thus costs O(k) per occupied cell plus O(k) per point near a boundary.
+ *
+ * The means are initialised with kmeans++ like dkm::kmeans_lloyd and every point gets the same closest mean, so
+ * the result is that of dkm::kmeans_lloyd up to the rounding of the means, which are summed in double precision
+ * per cell rather than point by point.
+ *
+ * @param data             Points to be clustered.
+ * @param k                Number of clusters.
+ * @param maxIter          Maximum number of iterations.
+ * @param seed             Seed of the kmeans++ initialisation, -1 for a random seed.
+ * @param epsilon          Convergence threshold, as for dkm::kmeans_lloyd.
+ * @param points_per_cell  Average number of points per cell the grid is sized for.
+ *
+ * @return std::tuple of the cluster means and the cluster label of every point, as for dkm::kmeans_lloyd.
+ */
+template <typename T, size_t N>
+std::tuple<std::vector<std::array<T, N>>, std::vector<uint32_t>> kmeans_grid(const std::vector<std::array<T, N>>& data,
+	uint32_t k,
+	int maxIter,
+	int seed = -1,
+	float epsilon = 0.0f,
+	size_t points_per_cell = 32) {
+	static_assert(std::is_floating_point<T>::value,
+		"kmeans_grid requires the template parameter T to be a floating point type (float, double)");
+	static_assert(N >= 1 && N <= 3, "kmeans_grid is meant for points of up to 3 dimensions");
+	assert(k > 0);
+	assert(maxIter > 0);
+	assert(data.size() >= k);
+	std::vector<std::array<T, N>> means = details::random_plusplus(data, k, seed);
+	const details::point_grid<T, N> grid(data, points_per_cell);
+	const auto& cells = grid.cells();
+	const auto& points = grid.points();
+	const double rounding = 8.0 * (N + 2) *
+		(static_cast<double>(std::numeric_limits<T>::epsilon()) + std::numeric_limits<double>::epsilon());
+
+	auto squared = [](const std::array<double, N>& x, const std::array<T, N>& mean) {
+		double sum = 0.0;
+		for (size_t d = 0; d < N; ++d) {
+			double delta = x[d] - static_cast<double>(mean[d]);
+			sum += delta * delta;
+		}
+		return sum;
+	};
+	// every point of the box is certainly closer to mean a than to mean j: the distances to the box centre rule it
+	// out by the triangle inequality, or else the convex difference of squared distances is negative at all corners
+	auto closer = [&](const typename details::point_grid<T, N>::cell& box, const std::array<double, N>& centre,
+					  double radius, double centre_a, const std::array<T, N>& a, const std::array<T, N>& j) {
+		const double centre_j = std::sqrt(squared(centre, j));
+		if ((centre_j - radius) * (1.0 - rounding) > (centre_a + radius) * (1.0 + rounding)) {
+			return true;
+		}
+		std::array<double, N> corner;
+		for (size_t c = 0; c < (size_t(1) << N); ++c) {
+			for (size_t d = 0; d < N; ++d) {
+				corner[d] = (c >> d) & 1 ? box.high[d] : box.low[d];
+			}
+			if (squared(corner, a) * (1.0 + rounding) >= squared(corner, j) * (1.0 - rounding)) {
+				return false;
+			}
+		}
+		return true;
+	};
+
+	// label of every cell in the last iteration, or k when its points were labelled individually
+	std::vector<uint32_t> cell_labels(cells.size());
+	std::vector<uint32_t> point_labels(points.size());
+	std::vector<std::array<T, N>> old_means;
+	std::vector<std::array<double, N>> sums(k);
+	std::vector<size_t> counts(k);
+	int count = 0;
+	do {
+		std::fill(sums.begin(), sums.end(), std::array<double, N>());
+		std::fill(counts.begin(), counts.end(), 0);
+		for (size_t c = 0; c < cells.size(); ++c) {
+			const auto& box = cells[c];
+			std::array<double, N> centre;
+			double radius = 0.0;
+			for (size_t d = 0; d < N; ++d) {
+				centre[d] = 0.5 * (box.low[d] + box.high[d]);
+				radius += 0.25 * (box.high[d] - box.low[d]) * (box.high[d] - box.low[d]);
+			}
+			radius = std::sqrt(radius);
+			uint32_t a = 0;
+			double best = squared(centre, means[0]);
+			for (uint32_t j = 1; j < k; ++j) {
+				double d = squared(centre, means[j]);
+				if (d < best) {
+					best = d;
+					a = j;
+				}
+			}
+			const double centre_a = std::sqrt(best);
+			bool uniform = true;
+			for (uint32_t j = 0; j < k && uniform; ++j) {
+				uniform = j == a || closer(box, centre, radius, centre_a, means[a], means[j]);
+			}
+			if (uniform) {
+				cell_labels[c] = a;
+				counts[a] += box.last - box.first;
+				for (size_t d = 0; d < N; ++d) {
+					sums[a][d] += box.sum[d];
+				}
+				continue;
+			}
+			cell_labels[c] = k;
+			for (size_t i = box.first; i < box.last; ++i) {
+				uint32_t label = details::closest_mean(points[i], means);
+				point_labels[i] = label;
+				++counts[label];
+				for (size_t d = 0; d < N; ++d) {
+					sums[label][d] += static_cast<double>(points[i][d]);
+				}
+			}
+		}
+		old_means = means;
+		for (uint32_t j = 0; j < k; ++j) {
+			if (counts[j] > 0) {
+				for (size_t d = 0; d < N; ++d) {
+					means[j][d] = static_cast<T>(sums[j][d] / static_cast<double>(counts[j]));
+				}
+			}
+		}
+		++count;
+	} while (details::point_collection_epsilon(means, old_means) > epsilon && count < maxIter);
+
+	std::vector<uint32_t> clusters(data.size());
+	for (size_t c = 0; c < cells.size(); ++c) {
+		for (size_t i = cells[c].first; i < cells[c].last; ++i) {
+			clusters[grid.index()[i]] = cell_labels[c] == k ? point_labels[i] : cell_labels[c];
+		}
+	}
+	return std::tuple<std::vector<std::array<T, N>>, std::vector<uint32_t>>(means, clusters);
+}
+
+} // namespace dkm
@@ -0,0 +1,203 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstdint>
+#include <limits>
+#include <tuple>
+#include <vector>
+
+#include "dkm.hpp"
+#include "dkm_merge.hpp"
+#include "dkm_parallel.hpp"
+
+namespace dkm {
+
+/**
+ * k-means of 8-bit points, e.g. the colours of a spectrogram image, over their histogram instead of the points.
+ *
+ * 8-bit points of N channels take at most 256^N distinct values, and images usually use far fewer. The points
+ * are counted into a dense histogram of 256^N bins, the occupied bins are clustered with k-means weighted by their
+ * counts, and the histogram is then turned into a lookup table from value to label. Clustering thus costs
+ * O(occupied bins) per iteration whatever the number of points, and labelling a point is a single table lookup.
+ *
+ * The table takes 4 * 256^N bytes, 64 MiB for three channels. Counting is split over threads by the value of the
+ * first channel, so every thread owns a contiguous part of the table and no counts are merged. The points are
+ * first distributed to the threads by that value in one pass, which takes another 4 bytes per point.
+ */
+template <size_t N>
+class histogram_kmeans {
+	static_assert(N >= 1 && N <= 3, "histogram_kmeans supports points of 1 to 3 channels");
+
+public:
+	/**
+	 * Cluster the values of `data`.
+	 *
+	 * @param data     Points to be clustered.
+	 * @param k        Number of clusters. Fewer means are found if there are fewer distinct values.
+	 * @param maxIter  Maximum number of weighted Lloyd iterations.
+	 * @param seed     Seed of the weighted kmeans++ initialisation, -1 for a random seed.
+	 * @param threads  Number of threads counting and labelling, 0 for one per hardware thread.
+	 */
+	histogram_kmeans(
+		const std::vector<std::array<uint8_t, N>>& data, uint32_t k, int maxIter, int seed = -1, unsigned threads = 0)
+		: table_(bins, 0), threads_(threads) {
+		assert(k > 0);
+		assert(maxIter > 0);
+		count(data);
+
+		std::vector<std::array<float, N>> values;
+		std::vector<double> weights;
+		for (size_t b = 0; b < bins; ++b) {
+			if (table_[b] != 0) {
+				values.push_back(value(b));
+				weights.push_back(static_cast<double>(table_[b]));
+			} else {
+				// labelled on demand, see label()
+				table_[b] = unlabelled;
+			}
+		}
+		if (values.size() <= k) {
+			means_ = values;
+			for (size_t v = 0; v < values.size(); ++v) {
+				table_[key(values[v])] = static_cast<uint32_t>(v);
+			}
+		} else {
+			details::weighted_kmeans(values, weights, k, maxIter, seed, means_);
+			// the labels weighted_kmeans returns predate its last update of the means when maxIter runs out, so
+			// label the bins against the final means, as label() does for the values missing from the data
+			for (auto& v : values) {
+				table_[key(v)] = details::closest_mean(v, means_);
+			}
+		}
+	}
+
+	/**
+	 * The cluster means, in channel units.
+	 */
+	const std::vector<std::array<float, N>>& means() const { return means_; }
+
+	/**
+	 * Label of any value: a table lookup for the values of the clustered data, the closest mean otherwise.
+	 */
+	uint32_t label(const std::array<uint8_t, N>& point) const {
+		uint32_t l = table_[key(point)];
+		if (l == unlabelled) {
+			std::array<float, N> p;
+			for (size_t d = 0; d < N; ++d) {
+				p[d] = static_cast<float>(point[d]);
+			}
+			l = details::closest_mean(p, means_);
+		}
+		return l;
+	}
+
+	/**
+	 * Label of every point, split over the threads given to the constructor.
+	 */
+	std::vector<uint32_t> labels(const std::vector<std::array<uint8_t, N>>& points) const {
+		std::vector<uint32_t> result(points.size());
+		details::parallel_ranges(points.size(), details::thread_count(threads_, points.size() / 65536 + 1),
+			[&](unsigned, size_t first, size_t last) {
+				for (size_t i = first; i < last; ++i) {
+					result[i] = label(points[i]);
+				}
+			});
+		return result;
+	}
+
+private:
+	static const size_t bins = size_t(1) << (8 * N);
+	static const uint32_t unlabelled = std::numeric_limits<uint32_t>::max();
+
+	template <typename U>
+	static size_t key(const std::array<U, N>& point) {
+		size_t k = 0;
+		for (size_t d = 0; d < N; ++d) {
+			k = (k << 8) | static_cast<size_t>(point[d]);
+		}
+		return k;
+	}
+
+	/*
+	Count the points into table_. Every thread takes a share of the points and sorts their keys into buckets by
+	the value of their first channel, grouped by the thread whose part of the table that value falls into; each
+	thread then counts its own buckets. Every point is thus read once, and no two threads write the same bin.
+	*/
+	void count(const std::vector<std::array<uint8_t, N>>& data) {
+		const unsigned threads = details::thread_count(threads_, data.size() / 65536 + 1);
+		if (threads == 1) {
+			for (auto& point : data) {
+				++table_[key(point)];
+			}
+			return;
+		}
+		// thread counting the bins of each first channel value, as parallel_ranges splits the 256 values
+		std::array<unsigned, 256> owner;
+		for (unsigned t = 0; t < threads; ++t) {
+			for (size_t v = 256 * t / threads; v < 256 * (t + 1) / threads; ++v) {
+				owner[v] = t;
+			}
+		}
+		// starts[t * threads + o]: where the keys thread t sorts out for owner o go
+		std::vector<size_t> starts(static_cast<size_t>(threads) * threads, 0);
+		details::parallel_ranges(data.size(), threads, [&](unsigned t, size_t first, size_t last) {
+			for (size_t i = first; i < last; ++i) {
+				++starts[t * threads + owner[data[i][0]]];
+			}
+		});
+		std::vector<size_t> bucket_starts(threads + 1, 0);
+		size_t position = 0;
+		for (unsigned o = 0; o < threads; ++o) {
+			bucket_starts[o] = position;
+			for (unsigned t = 0; t < threads; ++t) {
+				const size_t size = starts[t * threads + o];
+				starts[t * threads + o] = position;
+				position += size;
+			}
+		}
+		bucket_starts[threads] = position;
+		std::vector<uint32_t> keys(data.size());
+		details::parallel_ranges(data.size(), threads, [&](unsigned t, size_t first, size_t last) {
+			size_t* next = &starts[t * threads];
+			for (size_t i = first; i < last; ++i) {
+				keys[next[owner[data[i][0]]]++] = static_cast<uint32_t>(key(data[i]));
+			}
+		});
+		details::parallel_ranges(threads, threads, [&](unsigned o, size_t, size_t) {
+			for (size_t i = bucket_starts[o]; i < bucket_starts[o + 1]; ++i) {
+				++table_[keys[i]];
+			}
+		});
+	}
+
+	static std::array<float, N> value(size_t key) {
+		std::array<float, N> v;
+		for (size_t d = N; d-- > 0;) {
+			v[d] = static_cast<float>(key & 0xff);
+			key >>= 8;
+		}
+		return v;
+	}
+
+	// histogram while counting, then the label of every occupied bin
+	std::vector<uint32_t> table_;
+	unsigned threads_;
+	std::vector<std::array<float, N>> means_;
+};
+
+/**
+ * Cluster 8-bit points with dkm::histogram_kmeans.
+ *
+ * @return std::tuple of the cluster means and the cluster label of every point, as for dkm::kmeans_lloyd.
+ */
+template <size_t N>
+std::tuple<std::vector<std::array<float, N>>, std::vector<uint32_t>> kmeans_histogram(
+	const std::vector<std::array<uint8_t, N>>& data, uint32_t k, int maxIter, int seed = -1, unsigned threads = 0) {
+	histogram_kmeans<N> clustering(data, k, maxIter, seed, threads);
+	return std::tuple<std::vector<std::array<float, N>>, std::vector<uint32_t>>(
+		clustering.means(), clustering.labels(data));
+}
+
+} // namespace dkm
@@ -0,0 +1,160 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "dkm.hpp"
+#include "dkm_linalg.hpp"
+
+namespace dkm {
+
+/**
+ * Gaussian (RBF) kernel: k(a, b) = exp(-gamma * |a - b|^2)
+ */
+struct rbf_kernel {
+	double gamma;
+
+	explicit rbf_kernel(double gamma_ = 1.0) : gamma(gamma_) {}
+
+	template <typename T, size_t N>
+	double operator()(const std::array<T, N>& a, const std::array<T, N>& b) const {
+		return std::exp(-gamma * static_cast<double>(details::distance_squared(a, b)));
+	}
+};
+
+/**
+ * Polynomial kernel: k(a, b) = (gamma * <a, b> + coef0)^degree
+ */
+struct polynomial_kernel {
+	int degree;
+	double gamma;
+	double coef0;
+
+	explicit polynomial_kernel(int degree_ = 2, double gamma_ = 1.0, double coef0_ = 1.0)
+		: degree(degree_), gamma(gamma_), coef0(coef0_) {}
+
+	template <typename T, size_t N>
+	double operator()(const std::array<T, N>& a, const std::array<T, N>& b) const {
+		double dot = 0.0;
+		for (size_t i = 0; i < N; ++i) {
+			dot += static_cast<double>(a[i]) * static_cast<double>(b[i]);
+		}
+		return std::pow(gamma * dot + coef0, degree);
+	}
+};
+
+
+/**
+ * Rank-M Nyström approximation of a kernel's feature map, built from M landmark points.
+ *
+ * With K the kernel matrix of the landmarks and K = U L U^T its eigen decomposition, a point x is mapped to
+ * L^(-1/2) U^T [k(x, l_1), ..., k(x, l_M)], so that dot products of mapped points approximate the kernel. Directions
+ * belonging to (numerically) zero eigenvalues, e.g. from duplicate landmarks, are mapped to zero.
+ */
+template <typename T, size_t N, size_t M, typename Kernel>
+class nystroem_embedding {
+public:
+	nystroem_embedding(std::vector<std::array<T, N>> landmarks, Kernel kernel)
+		: landmarks_(std::move(landmarks)), kernel_(kernel), projection_(M * M, 0.0) {
+		assert(landmarks_.size() == M);
+		std::vector<double> gram(M * M);
+		for (size_t i = 0; i < M; ++i) {
+			for (size_t j = 0; j <= i; ++j) {
+				gram[i * M + j] = gram[j * M + i] = kernel_(landmarks_[i], landmarks_[j]);
+			}
+		}
+		std::vector<double> eigenvalues, eigenvectors;
+		details::symmetric_eigen(gram, M, eigenvalues, eigenvectors);
+		const double cutoff = std::max(eigenvalues[0], 0.0) * 1e-10;
+		for (size_t i = 0; i < M; ++i) {
+			if (eigenvalues[i] <= cutoff) {
+				continue;
+			}
+			double scale = 1.0 / std::sqrt(eigenvalues[i]);
+			for (size_t j = 0; j < M; ++j) {
+				projection_[i * M + j] = scale * eigenvectors[i * M + j];
+			}
+		}
+	}
+
+	/**
+	 * Map a single point into the M-dimensional embedding.
+	 */
+	std::array<T, M> operator()(const std::array<T, N>& point) const {
+		std::array<double, M> similarity;
+		for (size_t j = 0; j < M; ++j) {
+			similarity[j] = kernel_(point, landmarks_[j]);
+		}
+		std::array<T, M> result;
+		for (size_t i = 0; i < M; ++i) {
+			double value = 0.0;
+			const double* row = &projection_[i * M];
+			for (size_t j = 0; j < M; ++j) {
+				value += row[j] * similarity[j];
+			}
+			result[i] = static_cast<T>(value);
+		}
+		return result;
+	}
+
+	/**
+	 * Map a sequence of points into the embedding.
+	 */
+	std::vector<std::array<T, M>> transform(const std::vector<std::array<T, N>>& points) const {
+		std::vector<std::array<T, M>> result;
+		result.reserve(points.size());
+		for (auto& p : points) {
+			result.push_back((*this)(p));
+		}
+		return result;
+	}
+
+	const std::vector<std::array<T, N>>& landmarks() const { return landmarks_; }
+
+private:
+	std::vector<std::array<T, N>> landmarks_;
+	Kernel kernel_;
+	// row i holds the i-th eigenvector of the landmark kernel matrix scaled by 1/sqrt(eigenvalue)
+	std::vector<double> projection_;
+};
+
+/**
+ * Kernel k-means using a rank-M Nyström approximation of the kernel.
+ *
+ * M landmarks are picked from the data with kmeans++, every point is mapped into the M-dimensional Nyström
+ * embedding and dkm::kmeans_lloyd clusters the embedded points. Memory use is O(n * M) and the run time is linear
+ * in the number of points, instead of the O(n^2) of exact kernel k-means. M is given explicitly, e.g.
+ * `dkm::kmeans_kernel<64>(data, 3, dkm::rbf_kernel(0.5), 100)`.
+ *
+ * @param data     Points to be clustered, at least M of them.
+ * @param k        Number of clusters.
+ * @param kernel   Kernel function object, e.g. dkm::rbf_kernel or dkm::polynomial_kernel.
+ * @param maxIter  Maximum number of Lloyd iterations.
+ * @param seed     Seed of the landmark selection and of the kmeans++ initialisation, -1 for a random seed.
+ * @param epsilon  Convergence threshold passed to dkm::kmeans_lloyd.
+ *
+ * @return std::tuple of the cluster means in the embedding and the cluster label of every point.
+ */
+template <size_t M, typename T, size_t N, typename Kernel>
+std::tuple<std::vector<std::array<T, M>>, std::vector<uint32_t>> kmeans_kernel(
+	const std::vector<std::array<T, N>>& data,
+	uint32_t k,
+	const Kernel& kernel,
+	int maxIter,
+	int seed = -1,
+	float epsilon = 0.0f) {
+	static_assert(std::is_floating_point<T>::value,
+		"kmeans_kernel requires the template parameter T to be a floating point type (float, double)");
+	assert(data.size() >= M); // there must be at least M data points to pick the landmarks from
+	nystroem_embedding<T, N, M, Kernel> embedding(details::random_plusplus(data, M, seed), kernel);
+	return kmeans_lloyd(embedding.transform(data), k, maxIter, seed, epsilon);
+}
+
+} // namespace dkm
@@ -0,0 +1,63 @@
+#pragma once
+
+/*
+The entry point of libdkm (built from src/lib), dkm::lib::kmeans_lloyd. It's specialised for the listed value types
+and dimensions, whose definitions are precompiled in the library, so calls for them link against it instead of
+instantiating the templates; for other types and dimensions it's dkm::kmeans_lloyd. dkm::kmeans_lloyd itself is left
+alone and is always the header template.
+
+Only the closest mean kernel of the naive assignment step is dispatched: the library carries it compiled for AVX2
+and AVX-512 and picks the best one the CPU supports on first use. There's no SSE2 version, the baseline being the
+header's loop compiled for the default target, and the means update and kmeans++ seeding always run the baseline
+code.
+*/
+
+// Value types and dimensions kmeans_lloyd is precompiled for, as X-macro lists of (T, N) pairs
+#define DKM_LIB_DIMENSIONS(X, T) X(T, 1) X(T, 2) X(T, 3) X(T, 4) X(T, 8) X(T, 16) X(T, 32) X(T, 64) X(T, 128)
+#define DKM_LIB_INSTANCES(X) DKM_LIB_DIMENSIONS(X, float) DKM_LIB_DIMENSIONS(X, double)
+
+#include <array>
+#include <cstdint>
+#include <tuple>
+#include <vector>
+
+#include "dkm.hpp"
+
+#define DKM_LIB_DECLARE_KMEANS_LLOYD(T, N)                                                                       \
+	template <>                                                                                                  \
+	std::tuple<std::vector<std::array<T, N>>, std::vector<uint32_t>> kmeans_lloyd<T, N>(                         \
+		const std::vector<std::array<T, N>>& data, uint32_t k, int maxIter, int seed, float epsilon,            \
+		assignment method);
+
+namespace dkm {
+
+namespace lib {
+
+/**
+ * dkm::kmeans_lloyd, precompiled in libdkm for the value types and dimensions of DKM_LIB_INSTANCES, with the
+ * closest mean kernel of the best instruction set the CPU supports. The results are those of dkm::kmeans_lloyd.
+ */
+template <typename T, size_t N>
+std::tuple<std::vector<std::array<T, N>>, std::vector<uint32_t>> kmeans_lloyd(
+	const std::vector<std::array<T, N>>& data, uint32_t k, int maxIter, int seed = -1, float epsilon = 0.0f,
+	assignment method = assignment::naive) {
+	return dkm::kmeans_lloyd(data, k, maxIter, seed, epsilon, method);
+}
+
+DKM_LIB_INSTANCES(DKM_LIB_DECLARE_KMEANS_LLOYD)
+
+} // namespace lib
+
+/**
+ * Name of the instruction set variant of the libdkm kernels selected for this CPU: "avx512", "avx2" or
+ * "baseline".
+ */
+const char* library_isa();
+
+/**
+ * Use the kernels of the named instruction set ("avx512", "avx2" or "baseline") from now on, e.g. to compare them.
+ * Returns false, and changes nothing, if the CPU doesn't support it.
+ */
+bool select_library_isa(const char* name);
+
+} // namespace dkm
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <numeric>
+#include <vector>
+
+namespace dkm {
+
+/*
+Small dense linear algebra helpers shared by the extensions of dkm. Matrices are row-major std::vector<double>.
+These are private implementation details and shouldn't be referenced outside of dkm.
+*/
+namespace details {
+
+/*
+Eigen decomposition of a symmetric n x n matrix with the cyclic Jacobi method. On return `eigenvalues` holds the
+eigenvalues in descending order and row i of `eigenvectors` the unit eigenvector belonging to eigenvalue i.
+Intended for the small (up to a few hundred rows) matrices of the Nyström and PCA steps.
+*/
+inline void symmetric_eigen(
+	std::vector<double> a, size_t n, std::vector<double>& eigenvalues, std::vector<double>& eigenvectors) {
+	assert(a.size() == n * n);
+	std::vector<double> v(n * n, 0.0);
+	for (size_t i = 0; i < n; ++i) {
+		v[i * n + i] = 1.0;
+	}
+	for (int sweep = 0; sweep < 100; ++sweep) {
+		double off = 0.0, total = 0.0;
+		for (size_t i = 0; i < n; ++i) {
+			for (size_t j = 0; j < n; ++j) {
+				total += a[i * n + j] * a[i * n + j];
+				if (i != j) {
+					off += a[i * n + j] * a[i * n + j];
+				}
+			}
+		}
+		if (off <= 1e-30 * total || off == 0.0) {
+			break;
+		}
+		for (size_t p = 0; p + 1 < n; ++p) {
+			for (size_t q = p + 1; q < n; ++q) {
+				double apq = a[p * n + q];
+				if (apq == 0.0) {
+					continue;
+				}
+				double theta = (a[q * n + q] - a[p * n + p]) / (2.0 * apq);
+				double t = (theta >= 0.0 ? 1.0 : -1.0) / (std::abs(theta) + std::sqrt(theta * theta + 1.0));
+				double c = 1.0 / std::sqrt(t * t + 1.0);
+				double s = t * c;
+				for (size_t k = 0; k < n; ++k) {
+					double akp = a[k * n + p], akq = a[k * n + q];
+					a[k * n + p] = c * akp - s * akq;
+					a[k * n + q] = s * akp + c * akq;
+				}
+				for (size_t k = 0; k < n; ++k) {
+					double apk = a[p * n + k], aqk = a[q * n + k];
+					a[p * n + k] = c * apk - s * aqk;
+					a[q * n + k] = s * apk + c * aqk;
+				}
+				for (size_t k = 0; k < n; ++k) {
+					double vkp = v[k * n + p], vkq = v[k * n + q];
+					v[k * n + p] = c * vkp - s * vkq;
+					v[k * n + q] = s * vkp + c * vkq;
+				}
+			}
+		}
+	}
+	std::vector<size_t> order(n);
+	std::iota(order.begin(), order.end(), size_t(0));
+	std::sort(order.begin(), order.end(), [&a, n](size_t x, size_t y) { return a[x * n + x] > a[y * n + y]; });
+	eigenvalues.resize(n);
+	eigenvectors.resize(n * n);
+	for (size_t i = 0; i < n; ++i) {
+		eigenvalues[i] = a[order[i] * n + order[i]];
+		for (size_t k = 0; k < n; ++k) {
+			eigenvectors[i * n + k] = v[k * n + order[i]];
+		}
+	}
+}
+
+} // namespace details
+
+} // namespace dkm
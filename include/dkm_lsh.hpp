@@ -0,0 +1,197 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstdint>
+#include <random>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "dkm.hpp"
+
+namespace dkm {
+
+namespace details {
+
+/*
+Sign random projection hash: `tables` hash tables of `bits` random hyperplanes each, all passing through the
+centre of the data. Bit b of a point's code in table t is set when the point lies on the positive side of
+hyperplane t * bits + b, so points separated by a small angle around the centre tend to share codes.
+*/
+template <typename T, size_t N>
+class sign_projection_hash {
+public:
+	sign_projection_hash(const std::vector<std::array<T, N>>& data, uint32_t bits, uint32_t tables, int seed)
+		: bits_(bits), tables_(tables), planes_(static_cast<size_t>(bits) * tables), centre_() {
+		assert(bits > 0 && bits <= 32);
+		assert(tables > 0);
+		for (auto& point : data) {
+			for (size_t d = 0; d < N; ++d) {
+				centre_[d] += static_cast<double>(point[d]);
+			}
+		}
+		for (auto& c : centre_) {
+			c /= static_cast<double>(std::max<size_t>(data.size(), 1));
+		}
+		std::mt19937 engine(seed == -1 ? std::random_device()() : static_cast<uint32_t>(seed));
+		std::normal_distribution<double> normal;
+		for (auto& plane : planes_) {
+			for (auto& v : plane) {
+				v = normal(engine);
+			}
+		}
+	}
+
+	uint32_t tables() const { return tables_; }
+
+	/*
+	Write the code of `point` in every table to codes[0 .. tables).
+	*/
+	void hash(const std::array<T, N>& point, uint32_t* codes) const {
+		std::array<double, N> centred;
+		for (size_t d = 0; d < N; ++d) {
+			centred[d] = static_cast<double>(point[d]) - centre_[d];
+		}
+		for (uint32_t t = 0; t < tables_; ++t) {
+			uint32_t code = 0;
+			for (uint32_t b = 0; b < bits_; ++b) {
+				const auto& plane = planes_[t * bits_ + b];
+				double side = 0.0;
+				for (size_t d = 0; d < N; ++d) {
+					side += centred[d] * plane[d];
+				}
+				code |= static_cast<uint32_t>(side > 0.0) << b;
+			}
+			codes[t] = code;
+		}
+	}
+
+private:
+	uint32_t bits_;
+	uint32_t tables_;
+	std::vector<std::array<double, N>> planes_;
+	std::array<double, N> centre_;
+};
+
+/*
+Assign every point to the closest of the candidate means sharing a bucket with it in any table, plus the mean
+it was assigned to before. `point_codes` holds the tables codes of every point, row-major. The labels are updated
+in place.
+*/
+template <typename T, size_t N>
+void calculate_clusters_lsh(const std::vector<std::array<T, N>>& data,
+	const std::vector<std::array<T, N>>& means,
+	const sign_projection_hash<T, N>& hash,
+	const std::vector<uint32_t>& point_codes,
+	std::vector<uint32_t>& labels) {
+	const uint32_t k = static_cast<uint32_t>(means.size());
+	const uint32_t tables = hash.tables();
+	// every table sorted by code, so the means of a bucket are a contiguous range
+	std::vector<std::pair<uint32_t, uint32_t>> buckets(static_cast<size_t>(k) * tables);
+	std::vector<uint32_t> codes(tables);
+	for (uint32_t j = 0; j < k; ++j) {
+		hash.hash(means[j], codes.data());
+		for (uint32_t t = 0; t < tables; ++t) {
+			buckets[t * k + j] = {codes[t], j};
+		}
+	}
+	for (uint32_t t = 0; t < tables; ++t) {
+		std::sort(buckets.begin() + t * k, buckets.begin() + (t + 1) * k);
+	}
+
+	// visited[j] == i + 1 marks mean j as already evaluated for point i
+	std::vector<size_t> visited(k, 0);
+	for (size_t i = 0; i < data.size(); ++i) {
+		uint32_t best_index = labels[i];
+		T best = distance_squared(data[i], means[best_index]);
+		visited[best_index] = i + 1;
+		for (uint32_t t = 0; t < tables; ++t) {
+			auto first = buckets.begin() + t * k, last = first + k;
+			auto range = std::equal_range(first, last, std::make_pair(point_codes[i * tables + t], uint32_t(0)),
+				[](const std::pair<uint32_t, uint32_t>& a, const std::pair<uint32_t, uint32_t>& b) {
+					return a.first < b.first;
+				});
+			for (auto it = range.first; it != range.second; ++it) {
+				uint32_t j = it->second;
+				if (visited[j] == i + 1) {
+					continue;
+				}
+				visited[j] = i + 1;
+				T d = distance_squared(data[i], means[j]);
+				if (d < best || (d == best && j < best_index)) {
+					best = d;
+					best_index = j;
+				}
+			}
+		}
+		labels[i] = best_index;
+	}
+}
+
+} // namespace details
+
+
+/**
+ * Approximate k-means for high-dimensional data using locality sensitive hashing in the assignment step.
+ *
+ * Every point is hashed once with sign random projections into `tables` tables of `bits` bits each. In every
+ * iteration the means are hashed with the same projections, and each point only evaluates the means that share a
+ * bucket with it in at least one table, plus the mean it was assigned to in the previous iteration, so a point
+ * never moves to a farther mean. The first iteration assigns exactly, like dkm::kmeans_lloyd.
+ *
+ * `tables` and `bits` trade recall for speed: more tables find more of the true closest means at the cost of more
+ * candidates, more bits make buckets smaller and candidates fewer. Hashing a point costs bits * tables dot products,
+ * so bits * tables should stay well below k for the hashing to pay off.
+ *
+ * @param data     Points to be clustered.
+ * @param k        Number of clusters.
+ * @param maxIter  Maximum number of iterations.
+ * @param seed     Seed of the kmeans++ initialisation and of the projections, -1 for a random seed.
+ * @param epsilon  Convergence threshold, as for dkm::kmeans_lloyd.
+ * @param bits     Hyperplanes per table, at most 32.
+ * @param tables   Number of hash tables.
+ *
+ * @return std::tuple of the cluster means and the cluster label of every point, as for dkm::kmeans_lloyd.
+ */
+template <typename T, size_t N>
+std::tuple<std::vector<std::array<T, N>>, std::vector<uint32_t>> kmeans_lsh(const std::vector<std::array<T, N>>& data,
+	uint32_t k,
+	int maxIter,
+	int seed = -1,
+	float epsilon = 0.0f,
+	uint32_t bits = 8,
+	uint32_t tables = 4) {
+	static_assert(std::is_floating_point<T>::value,
+		"kmeans_lsh requires the template parameter T to be a floating point type (float, double)");
+	assert(k > 0);
+	assert(maxIter > 0);
+	assert(data.size() >= k);
+	std::vector<std::array<T, N>> means = details::random_plusplus(data, k, seed);
+
+	details::sign_projection_hash<T, N> hash(data, bits, tables, seed);
+	std::vector<uint32_t> point_codes(data.size() * tables);
+	for (size_t i = 0; i < data.size(); ++i) {
+		hash.hash(data[i], &point_codes[i * tables]);
+	}
+
+	std::vector<std::array<T, N>> old_means;
+	std::vector<uint32_t> clusters;
+	int count = 0;
+	do {
+		if (count == 0) {
+			clusters = details::calculate_clusters(data, means);
+		} else {
+			details::calculate_clusters_lsh(data, means, hash, point_codes, clusters);
+		}
+		old_means = means;
+		means = details::calculate_means(data, clusters, old_means, k);
+		++count;
+	} while (details::point_collection_epsilon(means, old_means) > epsilon && count < maxIter);
+
+	return std::tuple<std::vector<std::array<T, N>>, std::vector<uint32_t>>(means, clusters);
+}
+
+} // namespace dkm
@@ -0,0 +1,216 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstdint>
+#include <random>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+#include "dkm.hpp"
+
+namespace dkm {
+
+/**
+ * A clustering summarised without its points: the mean, number of points and, optionally, the sum of squared
+ * distances of the points to the mean (SSE) of every cluster. Models of separately clustered shards of a data set
+ * can be combined with dkm::merge_models. To label points with the result, build a dkm::model (dkm_predict.hpp)
+ * from its means.
+ */
+template <typename T, size_t N>
+struct cluster_model {
+	std::vector<std::array<T, N>> means;
+	std::vector<uint64_t> counts;
+	// empty when the SSE isn't known
+	std::vector<double> sse;
+};
+
+/**
+ * Summarise a dkm::kmeans_lloyd result (or any means and labels) as a dkm::cluster_model, including the SSE of
+ * every cluster.
+ */
+template <typename T, size_t N>
+cluster_model<T, N> make_model(const std::vector<std::array<T, N>>& data,
+	const std::tuple<std::vector<std::array<T, N>>, std::vector<uint32_t>>& clustering) {
+	const auto& means = std::get<0>(clustering);
+	const auto& labels = std::get<1>(clustering);
+	assert(labels.size() == data.size());
+	cluster_model<T, N> model;
+	model.means = means;
+	model.counts.assign(means.size(), 0);
+	model.sse.assign(means.size(), 0.0);
+	for (size_t i = 0; i < data.size(); ++i) {
+		++model.counts[labels[i]];
+		model.sse[labels[i]] += static_cast<double>(details::distance_squared(data[i], means[labels[i]]));
+	}
+	return model;
+}
+
+namespace details {
+
+/*
+k-means of weighted points: kmeans++ seeding with every point's probability scaled by its weight, followed by
+Lloyd iterations with weighted means, until no label changes or after maxIter iterations. Points of zero weight
+are never picked as initial means. Returns the label of every point; `means` receives the k means.
+*/
+template <typename T, size_t N>
+std::vector<uint32_t> weighted_kmeans(const std::vector<std::array<T, N>>& points,
+	const std::vector<double>& weights,
+	uint32_t k,
+	int maxIter,
+	int seed,
+	std::vector<std::array<T, N>>& means) {
+	assert(points.size() == weights.size());
+	std::linear_congruential_engine<uint64_t, 6364136223846793005, 1442695040888963407, UINT64_MAX> engine(
+		seed == -1 ? std::random_device()() : static_cast<uint32_t>(seed));
+	means.clear();
+	{
+		std::discrete_distribution<size_t> generator(weights.begin(), weights.end());
+		means.push_back(points[generator(engine)]);
+	}
+	std::vector<double> closest(points.size());
+	for (size_t i = 0; i < points.size(); ++i) {
+		closest[i] = static_cast<double>(distance_squared(points[i], means[0]));
+	}
+	std::vector<double> probabilities(points.size());
+	while (means.size() < k) {
+		for (size_t i = 0; i < points.size(); ++i) {
+			probabilities[i] = weights[i] * closest[i];
+		}
+		std::discrete_distribution<size_t> generator(probabilities.begin(), probabilities.end());
+		means.push_back(points[generator(engine)]);
+		for (size_t i = 0; i < points.size(); ++i) {
+			closest[i] = std::min(closest[i], static_cast<double>(distance_squared(points[i], means.back())));
+		}
+	}
+
+	std::vector<uint32_t> labels(points.size(), 0);
+	std::vector<std::array<double, N>> sums(k);
+	std::vector<double> totals(k);
+	for (int iteration = 0; iteration < maxIter; ++iteration) {
+		bool changed = iteration == 0;
+		for (size_t i = 0; i < points.size(); ++i) {
+			uint32_t label = closest_mean(points[i], means);
+			changed = changed || label != labels[i];
+			labels[i] = label;
+		}
+		if (!changed) {
+			break;
+		}
+		std::fill(sums.begin(), sums.end(), std::array<double, N>());
+		std::fill(totals.begin(), totals.end(), 0.0);
+		for (size_t i = 0; i < points.size(); ++i) {
+			for (size_t d = 0; d < N; ++d) {
+				sums[labels[i]][d] += weights[i] * static_cast<double>(points[i][d]);
+			}
+			totals[labels[i]] += weights[i];
+		}
+		for (uint32_t j = 0; j < k; ++j) {
+			if (totals[j] > 0.0) {
+				for (size_t d = 0; d < N; ++d) {
+					means[j][d] = static_cast<T>(sums[j][d] / totals[j]);
+				}
+			}
+		}
+	}
+	return labels;
+}
+
+} // namespace details
+
+
+/**
+ * Merge independently trained models, e.g. of the shards of a data set, into one model of k clusters without
+ * access to the points.
+ *
+ * The means of all models are clustered with k-means, each weighted by the number of points of its cluster. Every
+ * merged cluster is thus a union of input clusters, and its mean and count are exactly the mean and number of
+ * their points. When all models carry the SSE, the merged SSE is propagated exactly as well: the SSE of the input
+ * clusters plus count times the squared distance from their mean to the merged mean. The result is a model like
+ * the inputs, so merges can be nested in any reduction tree and the merged statistics always describe the points
+ * of the original data; the grouping itself depends on the order of the merges like any k-means result depends
+ * on its initialisation.
+ *
+ * Clusters without points are dropped. If k or fewer clusters remain, they are returned unchanged.
+ *
+ * @param models   Models to merge.
+ * @param k        Number of clusters of the merged model.
+ * @param maxIter  Maximum number of weighted Lloyd iterations.
+ * @param seed     Seed of the weighted kmeans++ initialisation, -1 for a random seed.
+ *
+ * @return The merged model, with at most k clusters.
+ */
+template <typename T, size_t N>
+cluster_model<T, N> merge_models(
+	const std::vector<cluster_model<T, N>>& models, uint32_t k, int maxIter = 100, int seed = -1) {
+	static_assert(std::is_floating_point<T>::value,
+		"merge_models requires the template parameter T to be a floating point type (float, double)");
+	assert(k > 0);
+	assert(maxIter > 0);
+	cluster_model<T, N> all;
+	bool with_sse = true;
+	for (auto& model : models) {
+		assert(model.counts.size() == model.means.size());
+		assert(model.sse.empty() || model.sse.size() == model.means.size());
+		with_sse = with_sse && !model.sse.empty();
+		for (size_t j = 0; j < model.means.size(); ++j) {
+			if (model.counts[j] == 0) {
+				continue;
+			}
+			all.means.push_back(model.means[j]);
+			all.counts.push_back(model.counts[j]);
+			all.sse.push_back(model.sse.empty() ? 0.0 : model.sse[j]);
+		}
+	}
+	if (!with_sse) {
+		all.sse.clear();
+	}
+	if (all.means.size() <= k) {
+		return all;
+	}
+
+	std::vector<double> weights(all.counts.begin(), all.counts.end());
+	std::vector<std::array<T, N>> centres;
+	auto labels = details::weighted_kmeans(all.means, weights, k, maxIter, seed, centres);
+
+	// recompute the means in double from the input means, as the weighted iterations may stop before settling
+	std::vector<std::array<double, N>> sums(k);
+	std::vector<uint64_t> counts(k, 0);
+	for (size_t i = 0; i < all.means.size(); ++i) {
+		counts[labels[i]] += all.counts[i];
+		for (size_t d = 0; d < N; ++d) {
+			sums[labels[i]][d] += weights[i] * static_cast<double>(all.means[i][d]);
+		}
+	}
+	// renumber the clusters that got any input, keeping their order
+	cluster_model<T, N> merged;
+	std::vector<uint32_t> index(k, 0);
+	for (uint32_t j = 0; j < k; ++j) {
+		if (counts[j] > 0) {
+			index[j] = static_cast<uint32_t>(merged.means.size());
+			std::array<T, N> mean;
+			for (size_t d = 0; d < N; ++d) {
+				mean[d] = static_cast<T>(sums[j][d] / static_cast<double>(counts[j]));
+			}
+			merged.means.push_back(mean);
+			merged.counts.push_back(counts[j]);
+		}
+	}
+	if (with_sse) {
+		merged.sse.assign(merged.means.size(), 0.0);
+		for (size_t i = 0; i < all.means.size(); ++i) {
+			const uint32_t j = index[labels[i]];
+			double shift = 0.0;
+			for (size_t d = 0; d < N; ++d) {
+				double delta = static_cast<double>(all.means[i][d]) - static_cast<double>(merged.means[j][d]);
+				shift += delta * delta;
+			}
+			merged.sse[j] += all.sse[i] + weights[i] * shift;
+		}
+	}
+	return merged;
+}
+
+} // namespace dkm
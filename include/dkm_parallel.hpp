@@ -0,0 +1,136 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace dkm {
+
+/*
+Threading helpers shared by the parallel extensions of dkm. These are private implementation details and shouldn't
+be referenced outside of dkm.
+*/
+namespace details {
+
+/*
+Resolve a requested number of threads (0 meaning one per hardware thread) for `items` units of work, never using
+more threads than there are units.
+*/
+inline unsigned thread_count(unsigned requested, size_t items) {
+	unsigned threads = requested != 0 ? requested : std::thread::hardware_concurrency();
+	threads = std::max(1u, threads);
+	return static_cast<unsigned>(std::max<size_t>(1, std::min<size_t>(threads, items)));
+}
+
+/*
+Split [0, n) into `threads` contiguous ranges and call `f(thread, first, last)` for each of them concurrently, the
+last range on the calling thread. The split only depends on n and the thread count, so per-thread partial results
+combined in thread order are reproducible.
+*/
+template <typename F>
+void parallel_ranges(size_t n, unsigned threads, F&& f) {
+	std::vector<std::thread> workers;
+	workers.reserve(threads > 0 ? threads - 1 : 0);
+	for (unsigned t = 0; t + 1 < threads; ++t) {
+		workers.emplace_back([&f, n, threads, t] { f(t, n * t / threads, n * (t + 1) / threads); });
+	}
+	if (threads > 0) {
+		f(threads - 1, n * (threads - 1) / threads, n);
+	}
+	for (auto& w : workers) {
+		w.join();
+	}
+}
+
+/*
+Threads started once and reused for many parallel passes, for loops that must not create threads per iteration.
+run() splits [0, n) exactly like parallel_ranges and returns once every range is done, so the calls of successive
+passes never overlap. Nothing is allocated after construction. run() is not reentrant and must only be called from
+the thread that owns the pool.
+*/
+class worker_pool {
+public:
+	explicit worker_pool(unsigned threads) : threads_(std::max(1u, threads)) {
+		workers_.reserve(threads_ - 1);
+		for (unsigned t = 0; t + 1 < threads_; ++t) {
+			workers_.emplace_back([this, t] { work(t); });
+		}
+	}
+
+	worker_pool(const worker_pool&) = delete;
+	worker_pool& operator=(const worker_pool&) = delete;
+
+	~worker_pool() {
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			stop_ = true;
+		}
+		start_.notify_all();
+		for (auto& w : workers_) {
+			w.join();
+		}
+	}
+
+	unsigned size() const { return threads_; }
+
+	// call `f(thread, first, last)` for each of the ranges concurrently, the last one on the calling thread
+	template <typename F>
+	void run(size_t n, F&& f) {
+		typedef typename std::remove_reference<F>::type function;
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			call_ = [](void* context, unsigned t, size_t first, size_t last) {
+				(*static_cast<function*>(context))(t, first, last);
+			};
+			context_ = const_cast<void*>(static_cast<const void*>(&f));
+			n_ = n;
+			pending_ = threads_ - 1;
+			++generation_;
+		}
+		start_.notify_all();
+		f(threads_ - 1, n * (threads_ - 1) / threads_, n);
+		std::unique_lock<std::mutex> lock(mutex_);
+		done_.wait(lock, [this] { return pending_ == 0; });
+	}
+
+private:
+	void work(unsigned t) {
+		size_t seen = 0;
+		for (;;) {
+			std::unique_lock<std::mutex> lock(mutex_);
+			start_.wait(lock, [this, seen] { return stop_ || generation_ != seen; });
+			if (stop_) {
+				return;
+			}
+			seen = generation_;
+			auto call = call_;
+			void* context = context_;
+			const size_t n = n_;
+			lock.unlock();
+			call(context, t, n * t / threads_, n * (t + 1) / threads_);
+			lock.lock();
+			if (--pending_ == 0) {
+				done_.notify_one();
+			}
+		}
+	}
+
+	const unsigned threads_;
+	std::vector<std::thread> workers_;
+	std::mutex mutex_;
+	std::condition_variable start_, done_;
+	void (*call_)(void*, unsigned, size_t, size_t) = nullptr;
+	void* context_ = nullptr;
+	size_t n_ = 0;
+	unsigned pending_ = 0;
+	size_t generation_ = 0;
+	bool stop_ = false;
+};
+
+} // namespace details
+
+} // namespace dkm
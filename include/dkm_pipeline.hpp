@@ -0,0 +1,172 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <istream>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+#include "dkm.hpp"
+#include "dkm_parallel.hpp"
+
+namespace dkm {
+
+/**
+ * Per-dimension mean and variance of a data set, accumulated one point at a time with Welford's algorithm.
+ */
+template <size_t N>
+struct column_statistics {
+	// number of points added
+	size_t count = 0;
+	// number of input lines that didn't hold N numbers and were skipped by dkm::load_csv
+	size_t skipped = 0;
+	std::array<double, N> mean{};
+	// sum of squared deviations from the mean, see variance()
+	std::array<double, N> m2{};
+
+	template <typename T>
+	void add(const std::array<T, N>& point) {
+		++count;
+		for (size_t d = 0; d < N; ++d) {
+			double x = static_cast<double>(point[d]);
+			double delta = x - mean[d];
+			mean[d] += delta / static_cast<double>(count);
+			m2[d] += delta * (x - mean[d]);
+		}
+	}
+
+	// population variance of dimension d
+	double variance(size_t d) const { return count > 0 ? m2[d] / static_cast<double>(count) : 0.0; }
+
+	// standard deviation of dimension d, 1 for constant dimensions so that scaling by it is always defined
+	double scale(size_t d) const {
+		double sd = std::sqrt(variance(d));
+		return sd > 0.0 ? sd : 1.0;
+	}
+};
+
+/**
+ * Load points from delimiter-separated text, one point per line, computing the per-dimension statistics in the
+ * same pass. The first N numbers of every line are used; lines without N numbers, such as headers, are skipped and
+ * counted in stats.skipped.
+ *
+ * @param in         Stream to read from.
+ * @param stats      Receives the mean and variance of every dimension.
+ * @param delimiter  Separator between the values of a line.
+ *
+ * @return The points read.
+ */
+template <typename T, size_t N>
+std::vector<std::array<T, N>> load_csv(std::istream& in, column_statistics<N>& stats, char delimiter = ',') {
+	stats = column_statistics<N>();
+	std::vector<std::array<T, N>> points;
+	std::string line;
+	std::array<T, N> point;
+	while (std::getline(in, line)) {
+		const char* cursor = line.c_str();
+		size_t d = 0;
+		while (d < N) {
+			char* end;
+			double value = std::strtod(cursor, &end);
+			if (end == cursor) {
+				break;
+			}
+			point[d++] = static_cast<T>(value);
+			cursor = end;
+			while (*cursor == ' ' || *cursor == '\t' || *cursor == '\r') {
+				++cursor;
+			}
+			if (d < N) {
+				if (*cursor != delimiter) {
+					break;
+				}
+				++cursor;
+			}
+		}
+		if (d != N) {
+			if (line.find_first_not_of(" \t\r") != std::string::npos) {
+				++stats.skipped;
+			}
+			continue;
+		}
+		stats.add(point);
+		points.push_back(point);
+	}
+	return points;
+}
+
+/**
+ * Standardise points in place to zero mean and unit variance per dimension (z-scores), splitting the points over
+ * `threads` threads (0 for one per hardware thread).
+ */
+template <typename T, size_t N>
+void standardize(std::vector<std::array<T, N>>& points, const column_statistics<N>& stats, unsigned threads = 0) {
+	static_assert(std::is_floating_point<T>::value,
+		"standardize requires the template parameter T to be a floating point type (float, double)");
+	std::array<T, N> offset, factor;
+	for (size_t d = 0; d < N; ++d) {
+		offset[d] = static_cast<T>(stats.mean[d]);
+		factor[d] = static_cast<T>(1.0 / stats.scale(d));
+	}
+	details::parallel_ranges(points.size(), details::thread_count(threads, points.size()),
+		[&](unsigned, size_t first, size_t last) {
+			for (size_t i = first; i < last; ++i) {
+				auto& point = points[i];
+				for (size_t d = 0; d < N; ++d) {
+					point[d] = (point[d] - offset[d]) * factor[d];
+				}
+			}
+		});
+}
+
+/**
+ * Map standardised points, e.g. cluster means, back into the original units.
+ */
+template <typename T, size_t N>
+std::vector<std::array<T, N>> unstandardize(std::vector<std::array<T, N>> points, const column_statistics<N>& stats) {
+	for (auto& point : points) {
+		for (size_t d = 0; d < N; ++d) {
+			point[d] = static_cast<T>(static_cast<double>(point[d]) * stats.scale(d) + stats.mean[d]);
+		}
+	}
+	return points;
+}
+
+/**
+ * Load, standardise and cluster delimiter-separated points in one go: the loader computes the per-dimension
+ * statistics while parsing, a single in-place pass turns the points into z-scores, dkm::kmeans_lloyd clusters
+ * them so that no dimension dominates through its units alone, and the means are mapped back to the original
+ * units.
+ *
+ * @param in         Stream to read the points from, see dkm::load_csv.
+ * @param k          Number of clusters.
+ * @param maxIter    Maximum number of iterations.
+ * @param seed       Seed of the kmeans++ initialisation, -1 for a random seed.
+ * @param epsilon    Convergence threshold passed to dkm::kmeans_lloyd.
+ * @param delimiter  Separator between the values of a line.
+ *
+ * @return std::tuple of the cluster means in the original units and the cluster label of every point.
+ */
+template <typename T, size_t N>
+std::tuple<std::vector<std::array<T, N>>, std::vector<uint32_t>> kmeans_csv(std::istream& in,
+	uint32_t k,
+	int maxIter,
+	int seed = -1,
+	float epsilon = 0.0f,
+	char delimiter = ',') {
+	column_statistics<N> stats;
+	auto points = load_csv<T, N>(in, stats, delimiter);
+	assert(points.size() >= k);
+	standardize(points, stats);
+	auto result = kmeans_lloyd(points, k, maxIter, seed, epsilon);
+	std::get<0>(result) = unstandardize(std::get<0>(result), stats);
+	return result;
+}
+
+} // namespace dkm
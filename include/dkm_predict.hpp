@@ -0,0 +1,191 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "dkm.hpp"
+#include "dkm_parallel.hpp"
+
+namespace dkm {
+
+/**
+ * The m nearest centroids of every point of a batch, see dkm::nearest_m.
+ */
+template <typename T>
+struct nearest_centroids {
+	// number of centroids per point
+	size_t m = 0;
+	// row-major points x m: the indices of the nearest centroids, closest first
+	std::vector<uint32_t> indices;
+	// the matching squared distances
+	std::vector<T> distances;
+};
+
+/**
+ * The closest centroid of a point together with how clearly it's the closest, see dkm::model::predict_with_margin.
+ */
+template <typename T>
+struct prediction {
+	uint32_t label;
+	// second closest centroid, the same as label when there's only one centroid
+	uint32_t runner_up;
+	// distance to the closest centroid
+	T distance;
+	// distance to the second closest centroid minus distance to the closest; 0 for a point on the boundary
+	T margin;
+};
+
+namespace details {
+
+/*
+Find the m nearest of `centroids` to a point in a single pass, writing their indices and squared distances,
+closest first, to indices[0 .. m) and distances[0 .. m). Ties go to the lower index, as in closest_mean, and for
+points with many dimensions a distance is abandoned once it can't make the list.
+*/
+template <typename T, size_t N>
+void nearest_m_point(const std::array<T, N>& point,
+	const std::vector<std::array<T, N>>& centroids,
+	size_t m,
+	uint32_t* indices,
+	T* distances) {
+	assert(m > 0 && m <= centroids.size());
+	size_t count = 0;
+	for (size_t j = 0; j < centroids.size(); ++j) {
+		T d = N >= partial_distance_min_dimensions && count == m
+			? distance_squared_bounded(point, centroids[j], distances[m - 1])
+			: distance_squared(point, centroids[j]);
+		if (count == m && !(d < distances[m - 1])) {
+			continue;
+		}
+		size_t position = count < m ? count++ : m - 1;
+		while (position > 0 && d < distances[position - 1]) {
+			distances[position] = distances[position - 1];
+			indices[position] = indices[position - 1];
+			--position;
+		}
+		distances[position] = d;
+		indices[position] = static_cast<uint32_t>(j);
+	}
+}
+
+/*
+Number of threads to use for a batch of points: a thread is only worth starting for a reasonable share of them.
+*/
+inline unsigned batch_threads(unsigned requested, size_t points) {
+	return thread_count(requested, points / 1024 + 1);
+}
+
+} // namespace details
+
+
+/**
+ * The m nearest centroids of every point, with their squared distances, found in a single pass over the
+ * centroids per point and split over `threads` threads (0 for one per hardware thread). m is capped at the number
+ * of centroids.
+ */
+template <typename T, size_t N>
+nearest_centroids<T> nearest_m(const std::vector<std::array<T, N>>& points,
+	const std::vector<std::array<T, N>>& centroids,
+	size_t m,
+	unsigned threads = 0) {
+	assert(!centroids.empty());
+	nearest_centroids<T> result;
+	result.m = std::min(std::max<size_t>(m, 1), centroids.size());
+	result.indices.resize(points.size() * result.m);
+	result.distances.resize(points.size() * result.m);
+	details::parallel_ranges(points.size(), details::batch_threads(threads, points.size()),
+		[&](unsigned, size_t first, size_t last) {
+			for (size_t i = first; i < last; ++i) {
+				details::nearest_m_point(
+					points[i], centroids, result.m, &result.indices[i * result.m], &result.distances[i * result.m]);
+			}
+		});
+	return result;
+}
+
+/**
+ * A trained clustering used to label new points, e.g. from dkm::kmeans_lloyd. Points are labelled by their closest
+ * mean, as kmeans_lloyd's assignment step does, and all batch operations split the points over `threads` threads (0
+ * for one per hardware thread). It holds only the means: dkm::cluster_model of dkm_merge.hpp is the summary with
+ * counts and SSE for merging clusterings, and a merged one is served as model(merged.means).
+ */
+template <typename T, size_t N>
+class model {
+public:
+	explicit model(std::vector<std::array<T, N>> means) : means_(std::move(means)) { assert(!means_.empty()); }
+
+	explicit model(const std::tuple<std::vector<std::array<T, N>>, std::vector<uint32_t>>& clustering)
+		: model(std::get<0>(clustering)) {}
+
+	const std::vector<std::array<T, N>>& means() const { return means_; }
+
+	/**
+	 * Label of the closest mean of a point.
+	 */
+	uint32_t predict(const std::array<T, N>& point) const { return details::closest_mean(point, means_); }
+
+	/**
+	 * Labels of a batch of points.
+	 */
+	std::vector<uint32_t> predict(const std::vector<std::array<T, N>>& points, unsigned threads = 0) const {
+		std::vector<uint32_t> labels(points.size());
+		details::parallel_ranges(points.size(), details::batch_threads(threads, points.size()),
+			[&](unsigned, size_t first, size_t last) {
+				for (size_t i = first; i < last; ++i) {
+					labels[i] = details::closest_mean(points[i], means_);
+				}
+			});
+		return labels;
+	}
+
+	/**
+	 * Label of the closest mean of a point with its distance and the margin to the second closest, for confidence
+	 * scores or to detect ambiguous points.
+	 */
+	prediction<T> predict_with_margin(const std::array<T, N>& point) const {
+		uint32_t indices[2];
+		T distances[2];
+		const size_t m = std::min<size_t>(2, means_.size());
+		details::nearest_m_point(point, means_, m, indices, distances);
+		prediction<T> result;
+		result.label = indices[0];
+		result.runner_up = indices[m - 1];
+		result.distance = static_cast<T>(std::sqrt(distances[0]));
+		result.margin = static_cast<T>(std::sqrt(distances[m - 1])) - result.distance;
+		return result;
+	}
+
+	/**
+	 * predict_with_margin for a batch of points.
+	 */
+	std::vector<prediction<T>> predict_with_margin(
+		const std::vector<std::array<T, N>>& points, unsigned threads = 0) const {
+		std::vector<prediction<T>> result(points.size());
+		details::parallel_ranges(points.size(), details::batch_threads(threads, points.size()),
+			[&](unsigned, size_t first, size_t last) {
+				for (size_t i = first; i < last; ++i) {
+					result[i] = predict_with_margin(points[i]);
+				}
+			});
+		return result;
+	}
+
+	/**
+	 * The m nearest means of a batch of points, see dkm::nearest_m.
+	 */
+	nearest_centroids<T> nearest(const std::vector<std::array<T, N>>& points, size_t m, unsigned threads = 0) const {
+		return nearest_m(points, means_, m, threads);
+	}
+
+private:
+	std::vector<std::array<T, N>> means_;
+};
+
+} // namespace dkm
@@ -0,0 +1,321 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "dkm.hpp"
+#include "dkm_linalg.hpp"
+#include "dkm_parallel.hpp"
+
+namespace dkm {
+
+namespace details {
+
+/*
+Orthonormalise the `cols` columns of the row-major rows x cols matrix `m` in place with modified Gram-Schmidt,
+projecting twice to keep the columns orthogonal when they are nearly dependent. Columns that are (numerically)
+linear combinations of the previous ones are set to zero.
+*/
+inline void orthonormalize_columns(std::vector<double>& m, size_t rows, size_t cols) {
+	auto norm = [&m, rows, cols](size_t c) {
+		double sum = 0.0;
+		for (size_t r = 0; r < rows; ++r) {
+			sum += m[r * cols + c] * m[r * cols + c];
+		}
+		return std::sqrt(sum);
+	};
+	for (size_t c = 0; c < cols; ++c) {
+		const double original = norm(c);
+		for (int pass = 0; pass < 2; ++pass) {
+			for (size_t p = 0; p < c; ++p) {
+				double dot = 0.0;
+				for (size_t r = 0; r < rows; ++r) {
+					dot += m[r * cols + c] * m[r * cols + p];
+				}
+				for (size_t r = 0; r < rows; ++r) {
+					m[r * cols + c] -= dot * m[r * cols + p];
+				}
+			}
+		}
+		const double remaining = norm(c);
+		const double scale = remaining > 1e-10 * original ? 1.0 / remaining : 0.0;
+		for (size_t r = 0; r < rows; ++r) {
+			m[r * cols + c] *= scale;
+		}
+	}
+}
+
+/*
+Map every point with `f(point)` into a vector of the results, splitting the points over threads.
+*/
+template <typename T, size_t N, typename U, size_t D, typename F>
+std::vector<std::array<U, D>> parallel_transform(const std::vector<std::array<T, N>>& points, unsigned threads, F&& f) {
+	std::vector<std::array<U, D>> result(points.size());
+	parallel_ranges(points.size(), thread_count(threads, points.size()), [&](unsigned, size_t first, size_t last) {
+		for (size_t i = first; i < last; ++i) {
+			result[i] = f(points[i]);
+		}
+	});
+	return result;
+}
+
+} // namespace details
+
+
+/**
+ * Very sparse Johnson-Lindenstrauss random projection from N to D dimensions.
+ *
+ * Every entry of the D x N projection matrix is +sqrt(s / D) or -sqrt(s / D) with probability 1 / (2 s) each and 0
+ * otherwise, with s = sqrt(N), so squared distances are preserved in expectation and projecting a point only
+ * touches about D * sqrt(N) of its values.
+ */
+template <typename T, size_t N, size_t D>
+class sparse_random_projection {
+public:
+	explicit sparse_random_projection(int seed = -1) : entries_(D) {
+		std::mt19937 engine(seed == -1 ? std::random_device()() : static_cast<uint32_t>(seed));
+		const double s = std::sqrt(static_cast<double>(N));
+		std::uniform_real_distribution<double> uniform(0.0, 1.0);
+		for (auto& row : entries_) {
+			for (uint32_t j = 0; j < N; ++j) {
+				double u = uniform(engine) * s;
+				if (u < 1.0) {
+					row.push_back({j, u < 0.5 ? 1.0 : -1.0});
+				}
+			}
+		}
+		scale_ = std::sqrt(s / static_cast<double>(D));
+	}
+
+	/**
+	 * Project a single point.
+	 */
+	std::array<T, D> operator()(const std::array<T, N>& point) const {
+		std::array<T, D> result;
+		for (size_t d = 0; d < D; ++d) {
+			double value = 0.0;
+			for (auto& entry : entries_[d]) {
+				value += entry.second * static_cast<double>(point[entry.first]);
+			}
+			result[d] = static_cast<T>(scale_ * value);
+		}
+		return result;
+	}
+
+	/**
+	 * Project a sequence of points, using `threads` threads (0 for one per hardware thread).
+	 */
+	std::vector<std::array<T, D>> transform(const std::vector<std::array<T, N>>& points, unsigned threads = 0) const {
+		return details::parallel_transform<T, N, T, D>(points, threads, *this);
+	}
+
+private:
+	// the non-zero entries of every row of the projection matrix: input dimension and sign
+	std::vector<std::vector<std::pair<uint32_t, double>>> entries_;
+	double scale_;
+};
+
+/**
+ * Projection of N-dimensional points onto their D principal components, found with a randomized SVD.
+ *
+ * A random Gaussian N x (D + oversampling) matrix is refined by `power_iterations` multiplications with X^T X (X
+ * being the centred data) into an orthonormal basis Q of the dominant subspace. The eigenvectors of the small
+ * matrix Q^T X^T X Q then give the principal components. Every multiplication is a single pass over the data,
+ * split over threads with one accumulator each, so fitting costs O(n * N * (D + oversampling)) per pass instead
+ * of the O(n * N^2) of forming the covariance matrix.
+ */
+template <typename T, size_t N, size_t D>
+class pca_projection {
+public:
+	pca_projection(const std::vector<std::array<T, N>>& data,
+		int seed = -1,
+		int power_iterations = 2,
+		size_t oversampling = 10,
+		unsigned threads = 0)
+		: mean_(), components_(D * N, 0.0), variances_(D, 0.0) {
+		static_assert(D <= N, "pca_projection can't project onto more dimensions than the data has");
+		assert(!data.empty());
+		const size_t l = std::min(D + oversampling, N);
+		const unsigned thread_count = details::thread_count(threads, data.size());
+		for (auto& point : data) {
+			for (size_t j = 0; j < N; ++j) {
+				mean_[j] += static_cast<double>(point[j]);
+			}
+		}
+		for (auto& m : mean_) {
+			m /= static_cast<double>(data.size());
+		}
+
+		std::mt19937 engine(seed == -1 ? std::random_device()() : static_cast<uint32_t>(seed));
+		std::normal_distribution<double> normal;
+		std::vector<double> basis(N * l); // N x l
+		for (auto& v : basis) {
+			v = normal(engine);
+		}
+		std::vector<std::vector<double>> partial(thread_count);
+		for (int iteration = 0; iteration < power_iterations; ++iteration) {
+			details::orthonormalize_columns(basis, N, l);
+			// basis = X^T X basis
+			details::parallel_ranges(data.size(), thread_count, [&](unsigned t, size_t first, size_t last) {
+				auto& sum = partial[t];
+				sum.assign(N * l, 0.0);
+				std::array<double, N> x;
+				std::vector<double> y(l);
+				for (size_t i = first; i < last; ++i) {
+					centre(data[i], x);
+					project(x, basis, l, y);
+					for (size_t j = 0; j < N; ++j) {
+						for (size_t c = 0; c < l; ++c) {
+							sum[j * l + c] += x[j] * y[c];
+						}
+					}
+				}
+			});
+			std::fill(basis.begin(), basis.end(), 0.0);
+			for (auto& sum : partial) {
+				for (size_t e = 0; e < basis.size(); ++e) {
+					basis[e] += sum[e];
+				}
+			}
+		}
+		details::orthonormalize_columns(basis, N, l);
+
+		// small = Q^T X^T X Q
+		details::parallel_ranges(data.size(), thread_count, [&](unsigned t, size_t first, size_t last) {
+			auto& sum = partial[t];
+			sum.assign(l * l, 0.0);
+			std::array<double, N> x;
+			std::vector<double> y(l);
+			for (size_t i = first; i < last; ++i) {
+				centre(data[i], x);
+				project(x, basis, l, y);
+				for (size_t a = 0; a < l; ++a) {
+					for (size_t b = 0; b < l; ++b) {
+						sum[a * l + b] += y[a] * y[b];
+					}
+				}
+			}
+		});
+		std::vector<double> small(l * l, 0.0);
+		for (auto& sum : partial) {
+			for (size_t e = 0; e < small.size(); ++e) {
+				small[e] += sum[e];
+			}
+		}
+		std::vector<double> eigenvalues, eigenvectors;
+		details::symmetric_eigen(small, l, eigenvalues, eigenvectors);
+		for (size_t d = 0; d < D; ++d) {
+			variances_[d] = std::max(eigenvalues[d], 0.0) / static_cast<double>(data.size());
+			for (size_t j = 0; j < N; ++j) {
+				double value = 0.0;
+				for (size_t c = 0; c < l; ++c) {
+					value += basis[j * l + c] * eigenvectors[d * l + c];
+				}
+				components_[d * N + j] = value;
+			}
+		}
+	}
+
+	/**
+	 * Project a single point onto the principal components.
+	 */
+	std::array<T, D> operator()(const std::array<T, N>& point) const {
+		std::array<double, N> x;
+		centre(point, x);
+		std::array<T, D> result;
+		for (size_t d = 0; d < D; ++d) {
+			const double* component = &components_[d * N];
+			double value = 0.0;
+			for (size_t j = 0; j < N; ++j) {
+				value += component[j] * x[j];
+			}
+			result[d] = static_cast<T>(value);
+		}
+		return result;
+	}
+
+	/**
+	 * Project a sequence of points, using `threads` threads (0 for one per hardware thread).
+	 */
+	std::vector<std::array<T, D>> transform(const std::vector<std::array<T, N>>& points, unsigned threads = 0) const {
+		return details::parallel_transform<T, N, T, D>(points, threads, *this);
+	}
+
+	// variance of the data along each principal component, largest first
+	const std::vector<double>& variances() const { return variances_; }
+
+private:
+	void centre(const std::array<T, N>& point, std::array<double, N>& x) const {
+		for (size_t j = 0; j < N; ++j) {
+			x[j] = static_cast<double>(point[j]) - mean_[j];
+		}
+	}
+
+	static void project(
+		const std::array<double, N>& x, const std::vector<double>& basis, size_t l, std::vector<double>& y) {
+		std::fill(y.begin(), y.end(), 0.0);
+		for (size_t j = 0; j < N; ++j) {
+			for (size_t c = 0; c < l; ++c) {
+				y[c] += x[j] * basis[j * l + c];
+			}
+		}
+	}
+
+	std::array<double, N> mean_;
+	// row d holds the d-th principal component
+	std::vector<double> components_;
+	std::vector<double> variances_;
+};
+
+/**
+ * Calculate the full-dimensional mean of every cluster from the labels of a clustering, e.g. one found on
+ * projected points. Clusters without points get a mean of zero.
+ *
+ * @param data    The original points.
+ * @param labels  Cluster label of every point.
+ * @param k       Number of clusters.
+ *
+ * @return The k cluster means in the original space.
+ */
+template <typename T, size_t N>
+std::vector<std::array<T, N>> means_from_labels(
+	const std::vector<std::array<T, N>>& data, const std::vector<uint32_t>& labels, uint32_t k) {
+	assert(labels.size() == data.size());
+	return details::calculate_means(data, labels, std::vector<std::array<T, N>>(k, std::array<T, N>()), k);
+}
+
+/**
+ * k-means on a lower-dimensional projection of the data: the points are projected with `projection` (e.g. a
+ * dkm::sparse_random_projection or dkm::pca_projection onto D dimensions), clustered with dkm::kmeans_lloyd and
+ * the cluster means are recomputed in the original space from the resulting labels.
+ *
+ * @param data        Points to be clustered.
+ * @param k           Number of clusters.
+ * @param projection  Projection from N to D dimensions, providing transform(points).
+ * @param maxIter     Maximum number of Lloyd iterations.
+ * @param seed        Seed of the kmeans++ initialisation, -1 for a random seed.
+ * @param epsilon     Convergence threshold passed to dkm::kmeans_lloyd.
+ *
+ * @return std::tuple of the full-dimensional cluster means and the cluster label of every point.
+ */
+template <typename T, size_t N, typename Projection>
+std::tuple<std::vector<std::array<T, N>>, std::vector<uint32_t>> kmeans_projected(
+	const std::vector<std::array<T, N>>& data,
+	uint32_t k,
+	const Projection& projection,
+	int maxIter,
+	int seed = -1,
+	float epsilon = 0.0f) {
+	auto labels = std::get<1>(kmeans_lloyd(projection.transform(data), k, maxIter, seed, epsilon));
+	return std::tuple<std::vector<std::array<T, N>>, std::vector<uint32_t>>(means_from_labels(data, labels, k), labels);
+}
+
+} // namespace dkm
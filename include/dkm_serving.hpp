@@ -0,0 +1,176 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "dkm_predict.hpp"
+
+namespace dkm {
+
+namespace details {
+
+/*
+Reader counter of an epoch, padded to a cache line of its own so readers on different cores don't contend.
+*/
+struct reader_counter {
+	std::atomic<size_t> count;
+	char padding[64 - sizeof(std::atomic<size_t>) % 64];
+};
+
+/*
+Stripe of the reader counters the calling thread uses; threads take stripes in turn as they first read.
+*/
+inline size_t reader_stripe() {
+	static std::atomic<size_t> next(0);
+	static thread_local size_t stripe = next.fetch_add(1);
+	return stripe;
+}
+
+} // namespace details
+
+
+/**
+ * A dkm::model shared by many threads predicting concurrently while a writer, e.g. a background retraining job,
+ * swaps in new means.
+ *
+ * Models are published read-copy-update style: every model is immutable once published, and a reader takes a
+ * snapshot of the current one without locking by counting itself in the current epoch, a lock-free increment of a
+ * counter striped over cache lines. publish() replaces the pointer to the current model atomically, then advances
+ * the epoch twice, each time waiting for the readers counted in the previous epoch to finish, after which no reader
+ * can still hold the old model and it's deleted. Readers therefore never wait for a writer and only ever see whole
+ * models; publishing waits for the snapshots in flight and is serialised between writers.
+ *
+ * A snapshot must not be held by the thread calling publish(), which would wait for it forever. The batch
+ * predict(points, threads) holds one snapshot for the whole batch, so that all points get labels from the same
+ * model, and a publish() started meanwhile waits until the batch is done; split very large batches to keep the
+ * writer from stalling.
+ */
+template <typename T, size_t N>
+class serving_model {
+	struct published {
+		model<T, N> value;
+		uint64_t version;
+	};
+
+public:
+	/**
+	 * A reader's hold on the model current when it was taken: the model stays alive, and unchanged, until the
+	 * snapshot is destroyed. Keep snapshots short lived, since publish() waits for them.
+	 */
+	class snapshot {
+	public:
+		snapshot(snapshot&& other) noexcept : counter_(other.counter_), model_(other.model_) {
+			other.counter_ = nullptr;
+		}
+		snapshot(const snapshot&) = delete;
+		snapshot& operator=(const snapshot&) = delete;
+		~snapshot() {
+			if (counter_ != nullptr) {
+				counter_->fetch_sub(1, std::memory_order_release);
+			}
+		}
+
+		const model<T, N>& operator*() const { return model_->value; }
+		const model<T, N>* operator->() const { return &model_->value; }
+		// number of models published before this one
+		uint64_t version() const { return model_->version; }
+
+	private:
+		friend class serving_model;
+		snapshot(std::atomic<size_t>* counter, const published* model) : counter_(counter), model_(model) {}
+
+		std::atomic<size_t>* counter_;
+		const published* model_;
+	};
+
+	explicit serving_model(model<T, N> initial) : current_(new published{std::move(initial), 0}), epoch_(0) {
+		for (auto& epoch : readers_) {
+			for (auto& counter : epoch) {
+				counter.count.store(0);
+			}
+		}
+	}
+
+	serving_model(const serving_model&) = delete;
+	serving_model& operator=(const serving_model&) = delete;
+
+	~serving_model() { delete current_.load(); }
+
+	/**
+	 * Snapshot of the current model, lock-free.
+	 */
+	snapshot acquire() const {
+		const size_t epoch = epoch_.load();
+		std::atomic<size_t>& counter = readers_[epoch & 1][details::reader_stripe() % stripes].count;
+		counter.fetch_add(1);
+		// loaded after the reader is counted, so publish() either waits for this reader or it sees the new model
+		return snapshot(&counter, current_.load());
+	}
+
+	/**
+	 * Make `next` the model of all snapshots taken from now on and delete the previous model once the snapshots
+	 * of it are gone.
+	 */
+	void publish(model<T, N> next) {
+		std::lock_guard<std::mutex> lock(writer_);
+		const published* old = current_.load();
+		current_.store(new published{std::move(next), old->version + 1});
+		// after the new model is visible, drain the readers of both epochs; diverting new readers to the other
+		// epoch first means a steady stream of them can't hold up the writer
+		for (int flip = 0; flip < 2; ++flip) {
+			const size_t epoch = epoch_.fetch_add(1);
+			for (auto& counter : readers_[epoch & 1]) {
+				while (counter.count.load() != 0) {
+					std::this_thread::yield();
+				}
+			}
+		}
+		delete old;
+	}
+
+	/**
+	 * Publish a model of new means, e.g. those of dkm::kmeans_lloyd.
+	 */
+	void publish(std::vector<std::array<T, N>> means) { publish(model<T, N>(std::move(means))); }
+
+	/**
+	 * Number of models published since construction.
+	 */
+	uint64_t version() const { return acquire().version(); }
+
+	/**
+	 * Label of the closest mean of a point in the current model.
+	 */
+	uint32_t predict(const std::array<T, N>& point) const { return acquire()->predict(point); }
+
+	/**
+	 * Labels of a batch of points, all from the same model, which publish() waits for until the batch is done.
+	 */
+	std::vector<uint32_t> predict(const std::vector<std::array<T, N>>& points, unsigned threads = 0) const {
+		return acquire()->predict(points, threads);
+	}
+
+	/**
+	 * dkm::model::predict_with_margin of a point in the current model.
+	 */
+	prediction<T> predict_with_margin(const std::array<T, N>& point) const {
+		return acquire()->predict_with_margin(point);
+	}
+
+private:
+	static const size_t stripes = 16;
+
+	std::atomic<const published*> current_;
+	std::atomic<size_t> epoch_;
+	// readers_[e & 1] counts the readers that started in epoch e
+	mutable std::array<std::array<details::reader_counter, stripes>, 2> readers_;
+	std::mutex writer_;
+};
+
+} // namespace dkm
@@ -2,6 +2,9 @@
 
 #include <algorithm>
 #include <array>
+#include <cassert>
+#include <cstdint>
+#include <numeric>
 #include <tuple>
 #include <vector>
 
@@ -103,17 +106,18 @@ T means_inertia(const std::vector<std::array<T, N>>& points,
  * @param points  Sequence of points to be clustered.
  * @param k		  Number of clusters
  * @param n_init  Number of times a k-means clustering will be calculated.
+ * @param max_iter Maximum number of iterations of each k-means clustering.
  *
  * @return Clustering with the lowest inertia.
  */
 template <typename T, size_t N>
 std::tuple<std::vector<std::array<T, N>>, std::vector<uint32_t>> get_best_means(
-	const std::vector<std::array<T, N>>& points, uint32_t k, uint32_t n_init = 10) {
-	auto best_means = kmeans_lloyd(points, k);
+	const std::vector<std::array<T, N>>& points, uint32_t k, uint32_t n_init = 10, int max_iter = 100) {
+	auto best_means = kmeans_lloyd(points, k, max_iter);
 	auto best_inertia = means_inertia(points, best_means, k);
 
 	for (uint32_t i = 0; i < n_init - 1; ++i) {
-		auto curr_means = kmeans_lloyd(points, k);
+		auto curr_means = kmeans_lloyd(points, k, max_iter);
 		auto curr_inertia = means_inertia(points, curr_means, k);
 		if (curr_inertia < best_inertia) {
 			best_inertia = curr_inertia;
@@ -0,0 +1,379 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <deque>
+#include <limits>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+#include "dkm.hpp"
+
+namespace dkm {
+
+namespace details {
+
+/*
+Find the closest and second closest mean to a point, returning the index of the closest mean and the (euclidean)
+distances to both. With a single mean the second distance is infinite.
+*/
+template <typename T, size_t N>
+uint32_t closest_two_means(const std::array<T, N>& point,
+	const std::vector<std::array<T, N>>& means,
+	T& closest_distance,
+	T& second_distance) {
+	assert(!means.empty());
+	T closest = distance_squared(point, means[0]);
+	T second = std::numeric_limits<T>::infinity();
+	uint32_t index = 0;
+	for (size_t i = 1; i < means.size(); ++i) {
+		T d = distance_squared(point, means[i]);
+		if (d < closest) {
+			second = closest;
+			closest = d;
+			index = static_cast<uint32_t>(i);
+		} else if (d < second) {
+			second = d;
+		}
+	}
+	closest_distance = std::sqrt(closest);
+	second_distance = std::sqrt(second);
+	return index;
+}
+
+} // namespace details
+
+
+/**
+ * k-means over a sliding window of a continuous stream of points, e.g. the feature frames of the last few seconds
+ * of audio.
+ *
+ * Every `push` appends the new frames, drops the frames that fell out of the window and refines the previous
+ * clustering with warm-started Lloyd iterations. Cluster sums and counts are updated incrementally for added,
+ * expired and relabelled points, and every point carries Hamerly-style bounds on the distance to its own and to
+ * the second closest mean. The bounds are stored relative to the total drift of the means since the start, so the
+ * drift is applied to all of them at once, and the points of every cluster are kept in a heap ordered by the slack
+ * of their bounds. A Lloyd iteration therefore only visits the new frames and the points whose bounds the drift
+ * has used up, each at a cost of O(log W); points far from a cluster boundary aren't touched at all, so a hop costs
+ * time in proportion to the hop size and the frames near a boundary rather than to the window size W. When a push
+ * visits so many frames that the heaps cost more than they save, e.g. for heavily overlapping clusters, the
+ * following pushes sweep the window in every iteration instead, at O(W) an iteration, until the frames visited
+ * drop well below that again.
+ *
+ * The window is initialised with dkm::kmeans_lloyd once it holds k frames.
+ */
+template <typename T, size_t N>
+class sliding_window_kmeans {
+	static_assert(std::is_floating_point<T>::value,
+		"sliding_window_kmeans requires the template parameter T to be a floating point type (float, double)");
+
+public:
+	/**
+	 * @param k        Number of clusters.
+	 * @param window   Number of frames kept in the window.
+	 * @param max_iter Maximum number of Lloyd iterations run per push.
+	 * @param seed     Seed of the kmeans++ initialisation, -1 for a random seed.
+	 */
+	sliding_window_kmeans(uint32_t k, size_t window, int max_iter = 10, int seed = -1)
+		: k_(k), window_(window), max_iter_(max_iter), seed_(seed), first_(0), max_drift_(0.0), moved_(false),
+		  queued_(true), changed_(false), visited_(0) {
+		assert(k > 0);
+		assert(window >= k);
+		assert(max_iter > 0);
+	}
+
+	/**
+	 * Append frames to the window, expire the oldest frames and update the clustering.
+	 *
+	 * @param frames New frames, oldest first.
+	 */
+	void push(const std::vector<std::array<T, N>>& frames) {
+		visited_ = 0;
+		if (means_.empty()) {
+			for (auto& f : frames) {
+				frames_.push_back({f, 0, 0.0, 0.0, 0});
+			}
+			expire();
+			if (frames_.size() < k_) {
+				return;
+			}
+			initialize();
+		} else {
+			for (auto& f : frames) {
+				frames_.push_back({f, 0, 0.0, 0.0, 0});
+				assign(frames_.back(), frames_.size() - 1);
+				add(frames_.back());
+				++visited_;
+			}
+			expire();
+			update_means();
+		}
+		size_t iterations = 1;
+		for (int i = 0; i < max_iter_; ++i, ++iterations) {
+			if (!refine()) {
+				break;
+			}
+		}
+		// a heap operation costs about as much as checking the bounds of some 30 frames in a sweep; switch between
+		// the two with some hysteresis
+		if (queued_ && visited_ * 32 > frames_.size() * iterations) {
+			queued_ = false;
+			heaps_.assign(k_, std::vector<pending>());
+		} else if (!queued_ && visited_ * 64 < frames_.size() * iterations) {
+			queued_ = true;
+			rebuild_heaps();
+		} else if (queued_ && heap_entries() > 2 * frames_.size() + 16 * k_) {
+			rebuild_heaps();
+		}
+	}
+
+	/**
+	 * Current cluster means, empty until the window holds k frames.
+	 */
+	const std::vector<std::array<T, N>>& means() const { return means_; }
+
+	/**
+	 * Cluster label of every frame in the window, oldest first.
+	 */
+	std::vector<uint32_t> labels() const {
+		std::vector<uint32_t> result;
+		result.reserve(frames_.size());
+		for (auto& f : frames_) {
+			result.push_back(f.label);
+		}
+		return result;
+	}
+
+	/**
+	 * Number of frames currently in the window.
+	 */
+	size_t size() const { return frames_.size(); }
+
+	/**
+	 * Number of times the last push computed distances of a frame, counting the new frames once each, e.g. to check
+	 * that a hop only visits a small part of the window.
+	 */
+	size_t visited() const { return visited_; }
+
+private:
+	/*
+	The bounds of a frame are stored relative to the total drift: its upper bound is upper + drift_[label] and
+	its lower bound is lower - max_drift_. They're kept in double precision as the drift grows over the whole
+	stream.
+	*/
+	struct entry {
+		std::array<T, N> point;
+		uint32_t label;
+		double upper;
+		double lower;
+		// incremented whenever the bounds are reset, to tell the current heap entry of the frame from older ones
+		uint32_t version;
+	};
+
+	/*
+	A frame in the heap of its cluster. The frame's bounds may overlap once the drift of its cluster plus the
+	largest drift reaches the slack lower - upper, so the heap pops the smallest slack first.
+	*/
+	struct pending {
+		double slack;
+		size_t id;
+		uint32_t version;
+		bool operator<(const pending& other) const { return slack > other.slack; }
+	};
+
+	void add(const entry& e) {
+		auto& sum = sums_[e.label];
+		for (size_t i = 0; i < N; ++i) {
+			sum[i] += e.point[i];
+		}
+		++counts_[e.label];
+	}
+
+	void remove(const entry& e) {
+		auto& sum = sums_[e.label];
+		for (size_t i = 0; i < N; ++i) {
+			sum[i] -= e.point[i];
+		}
+		--counts_[e.label];
+	}
+
+	void expire() {
+		while (frames_.size() > window_) {
+			if (!means_.empty()) {
+				remove(frames_.front());
+			}
+			frames_.pop_front();
+			++first_;
+		}
+	}
+
+	/*
+	Label frame f, at `index` in the window, with its closest mean, set its bounds exactly and queue it.
+	*/
+	void assign(entry& f, size_t index) {
+		T upper, lower;
+		f.label = details::closest_two_means(f.point, means_, upper, lower);
+		set_bounds(f, index, static_cast<double>(upper), static_cast<double>(lower));
+	}
+
+	void set_bounds(entry& f, size_t index, double upper, double lower) {
+		f.upper = upper - drift_[f.label];
+		f.lower = lower + max_drift_;
+		++f.version;
+		if (queued_) {
+			heaps_[f.label].push_back({f.lower - f.upper, first_ + index, f.version});
+			std::push_heap(heaps_[f.label].begin(), heaps_[f.label].end());
+		}
+	}
+
+	size_t heap_entries() const {
+		size_t total = 0;
+		for (auto& heap : heaps_) {
+			total += heap.size();
+		}
+		return total;
+	}
+
+	// drop the entries of expired frames and the outdated entries of the others
+	void rebuild_heaps() {
+		for (auto& heap : heaps_) {
+			heap.clear();
+		}
+		for (size_t index = 0; index < frames_.size(); ++index) {
+			const entry& f = frames_[index];
+			heaps_[f.label].push_back({f.lower - f.upper, first_ + index, f.version});
+		}
+		for (auto& heap : heaps_) {
+			std::make_heap(heap.begin(), heap.end());
+		}
+	}
+
+	void initialize() {
+		std::vector<std::array<T, N>> data;
+		data.reserve(frames_.size());
+		for (auto& f : frames_) {
+			data.push_back(f.point);
+		}
+		means_ = std::get<0>(kmeans_lloyd(data, k_, max_iter_, seed_));
+		sums_.assign(k_, std::array<double, N>());
+		counts_.assign(k_, 0);
+		drift_.assign(k_, 0.0);
+		max_drift_ = 0.0;
+		heaps_.assign(k_, std::vector<pending>());
+		size_t index = 0;
+		for (auto& f : frames_) {
+			assign(f, index++);
+			add(f);
+		}
+		update_means();
+	}
+
+	/*
+	Recalculate the means from the cluster sums and accumulate how far each of them moved. Empty clusters keep
+	their previous mean.
+	*/
+	void update_means() {
+		double largest = 0.0;
+		for (uint32_t j = 0; j < k_; ++j) {
+			if (counts_[j] == 0) {
+				continue;
+			}
+			std::array<T, N> mean;
+			for (size_t i = 0; i < N; ++i) {
+				mean[i] = static_cast<T>(sums_[j][i] / static_cast<double>(counts_[j]));
+			}
+			double moved = static_cast<double>(details::distance(mean, means_[j]));
+			means_[j] = mean;
+			drift_[j] += moved;
+			largest = std::max(largest, moved);
+		}
+		max_drift_ += largest;
+		moved_ = largest > 0.0;
+	}
+
+	/*
+	One Lloyd iteration over the window: recompute the distances of the points whose bounds the drift may have made
+	overlap and move the points that changed cluster. Returns false when the means didn't move since the last
+	iteration, as no label can change then.
+	*/
+	bool refine() {
+		if (!moved_) {
+			return false;
+		}
+		changed_ = false;
+		if (!queued_) {
+			size_t index = 0;
+			for (auto& f : frames_) {
+				if (f.lower - f.upper < drift_[f.label] + max_drift_) {
+					visit(f, index);
+				}
+				++index;
+			}
+			update_means();
+			return changed_;
+		}
+		popped_.clear();
+		for (uint32_t j = 0; j < k_; ++j) {
+			auto& heap = heaps_[j];
+			const double reach = drift_[j] + max_drift_;
+			while (!heap.empty() && heap.front().slack < reach) {
+				popped_.push_back(heap.front());
+				std::pop_heap(heap.begin(), heap.end());
+				heap.pop_back();
+			}
+		}
+		// the frames are requeued only after all heaps are drained, so none is visited twice in an iteration
+		for (auto& p : popped_) {
+			if (p.id >= first_ && frames_[p.id - first_].version == p.version) {
+				visit(frames_[p.id - first_], p.id - first_);
+			}
+		}
+		update_means();
+		return changed_;
+	}
+
+	// recompute the bounds of frame f, at `index` in the window, and move it if its closest mean changed
+	void visit(entry& f, size_t index) {
+		++visited_;
+		const double upper = static_cast<double>(details::distance(f.point, means_[f.label]));
+		const double lower = f.lower - max_drift_;
+		if (upper <= lower) {
+			set_bounds(f, index, upper, lower);
+			return;
+		}
+		const uint32_t label = f.label;
+		remove(f);
+		assign(f, index);
+		add(f);
+		changed_ = changed_ || f.label != label;
+	}
+
+	uint32_t k_;
+	size_t window_;
+	int max_iter_;
+	int seed_;
+	std::deque<entry> frames_;
+	// number of frames expired so far, the id of the oldest frame in the window
+	size_t first_;
+	std::vector<std::array<T, N>> means_;
+	// sums are kept in double precision as they are updated incrementally over the whole stream
+	std::vector<std::array<double, N>> sums_;
+	std::vector<size_t> counts_;
+	// total drift of every mean, and the sum of the largest drift of every update, since initialisation
+	std::vector<double> drift_;
+	double max_drift_;
+	bool moved_;
+	// whether the frames are queued in the heaps, or the window is swept in every iteration
+	bool queued_;
+	bool changed_;
+	// a heap of pending entries per cluster, and the entries popped in the current iteration
+	std::vector<std::vector<pending>> heaps_;
+	std::vector<pending> popped_;
+	size_t visited_;
+};
+
+} // namespace dkm
@@ -1,11 +1,22 @@
 /*
-Test cases for dkm.hpp
+Benchmarks for dkm.hpp
 
-This is just simple test harness without any external dependencies.
+Without arguments the iris data set is clustered with dkm (and OpenCV, when available) and the average run time
+is printed. Scaling curves and regression checks are available as:
+
+  dkm_bench --scaling [results.json] [--threads P]
+  dkm_bench --compare baseline.json current.json [--threshold 0.1]
+  dkm_bench --lsh
+  dkm_bench --balanced
 */
 
 #include "../../include/dkm.hpp"
+#include "../../include/dkm_balanced.hpp"
+#include "../../include/dkm_lsh.hpp"
+#include "../datagen/datagen.hpp"
+#ifdef DKM_BENCH_OPENCV
 #include "opencv2/opencv.hpp"
+#endif
 
 #include <vector>
 #include <array>
@@ -17,6 +28,15 @@ This is just simple test harness without any external dependencies.
 #include <chrono>
 #include <numeric>
 #include <regex>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <random>
+#include <sstream>
+#include <thread>
+#include <functional>
+#include <iomanip>
 
 // Split a line on commas, making it simple to pull out the values we need
 std::vector<std::string> split_commas(const std::string& line) {
@@ -41,6 +61,7 @@ void print_result_dkm(std::tuple<std::vector<std::array<T, N>>, std::vector<uint
 	std::cout << std::endl;
 }
 
+#ifdef DKM_BENCH_OPENCV
 cv::Mat load_opencv() {
 	std::cout << "Loading small OpenCV dataset...";
 	std::ifstream file("iris.data.csv");
@@ -56,6 +77,7 @@ cv::Mat load_opencv() {
 	std::cout << "done" << std::endl;
 	return data;
 }
+#endif
 
 std::vector<std::array<float, 2>> load_dkm() {
 	std::cout << "Loading small dkm dataset...";
@@ -70,6 +92,7 @@ std::vector<std::array<float, 2>> load_dkm() {
 	return data;
 }
 
+#ifdef DKM_BENCH_OPENCV
 std::chrono::duration<double> profile_opencv(const cv::Mat& data, int k) {
 	std::cout << "--- Profiling OpenCV kmeans ---" << std::endl;
 	std::cout << "Running kmeans..." << std::endl;
@@ -88,6 +111,7 @@ std::chrono::duration<double> profile_opencv(const cv::Mat& data, int k) {
 	std::cout << "done" << std::endl;
 	return (end - start) / 10.0;
 }
+#endif
 
 std::chrono::duration<double> profile_dkm(const std::vector<std::array<float, 2>>& data, int k) {
 	std::cout << "--- Profiling dkm kmeans ---" << std::endl;
@@ -95,25 +119,346 @@ std::chrono::duration<double> profile_dkm(const std::vector<std::array<float, 2>
 	auto start = std::chrono::high_resolution_clock::now();
 	// run the bench 10 times and take the average
 	for (int i = 0; i < 10; ++i) {
-		auto result = dkm::kmeans_lloyd(data, k);
+		auto result = dkm::kmeans_lloyd(data, k, 100);
 		print_result_dkm(result);
 	}
 	auto end = std::chrono::high_resolution_clock::now();
 	return (end - start) / 10.0;
 }
 
-int main() {
+/*
+One point of a scaling curve. `threads` clustering jobs (or fewer, for strong scaling) run concurrently, each
+on its own copy of an n x dims data set with k clusters.
+*/
+struct scaling_result {
+	std::string curve;
+	size_t threads;
+	size_t jobs;
+	size_t n;
+	size_t k;
+	size_t dims;
+	double seconds;
+};
+
+template <size_t N>
+std::vector<std::array<float, N>> gaussian_blobs(size_t n, size_t k, uint64_t seed) {
+	datagen::spec s;
+	s.n = n;
+	s.clusters = k;
+	s.seed = seed;
+	s.spread = 5.0;
+	s.separation = 50.0;
+	return datagen::generate<float, N>(s);
+}
+
+/*
+Time `jobs` independent k-means runs spread over `threads` threads. dkm runs each clustering on a single thread,
+so this measures how many concurrent clusterings a machine sustains. The best of three repetitions is kept.
+*/
+template <size_t N>
+double time_jobs(const std::vector<std::array<float, N>>& data, uint32_t k, size_t jobs, size_t threads) {
+	const int max_iter = 20;
+	const int seed = 1;
+	double best = 0.0;
+	for (int repetition = 0; repetition < 3; ++repetition) {
+		auto start = std::chrono::high_resolution_clock::now();
+		std::vector<std::thread> workers;
+		for (size_t t = 0; t < threads; ++t) {
+			workers.emplace_back([&data, k, jobs, threads, t] {
+				for (size_t job = t; job < jobs; job += threads) {
+					auto result = dkm::kmeans_lloyd(data, k, max_iter, seed);
+					(void)result;
+				}
+			});
+		}
+		for (auto& w : workers) {
+			w.join();
+		}
+		double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+		best = repetition == 0 ? seconds : std::min(best, seconds);
+	}
+	return best;
+}
+
+std::vector<scaling_result> run_scaling(size_t max_threads) {
+	const size_t dims = 8;
+	std::vector<scaling_result> results;
+	auto record = [&results](const char* curve, size_t threads, size_t jobs, size_t n, size_t k, double seconds) {
+		results.push_back({curve, threads, jobs, n, k, dims, seconds});
+		std::cerr << curve << " threads=" << threads << " jobs=" << jobs << " n=" << n << " k=" << k
+				  << " dims=" << dims << " " << seconds * 1000.0 << "ms" << std::endl;
+	};
+
+	{
+		const size_t n = 20000, k = 16;
+		auto data = gaussian_blobs<dims>(n, k, 42);
+		// strong scaling: a fixed batch of jobs shared by a growing number of threads
+		for (size_t threads = 1; threads <= max_threads; ++threads) {
+			record("strong", threads, max_threads, n, k, time_jobs(data, k, max_threads, threads));
+		}
+		// weak scaling: one job per thread
+		for (size_t threads = 1; threads <= max_threads; ++threads) {
+			record("weak", threads, threads, n, k, time_jobs(data, k, threads, threads));
+		}
+	}
+	for (size_t n = 1000; n <= 256000; n *= 4) {
+		auto data = gaussian_blobs<dims>(n, 8, 42);
+		record("n", 1, 1, n, 8, time_jobs(data, 8, 1, 1));
+	}
+	{
+		const size_t n = 32000;
+		for (size_t k = 2; k <= 64; k *= 2) {
+			auto data = gaussian_blobs<dims>(n, k, 42);
+			record("k", 1, 1, n, k, time_jobs(data, static_cast<uint32_t>(k), 1, 1));
+		}
+	}
+	return results;
+}
+
+void write_json(std::ostream& out, const std::vector<scaling_result>& results) {
+	out << "{\n  \"hardware_concurrency\": " << std::thread::hardware_concurrency() << ",\n  \"results\": [\n";
+	for (size_t i = 0; i < results.size(); ++i) {
+		auto& r = results[i];
+		out << "    {\"curve\": \"" << r.curve << "\", \"threads\": " << r.threads << ", \"jobs\": " << r.jobs
+			<< ", \"n\": " << r.n << ", \"k\": " << r.k << ", \"dims\": " << r.dims << ", \"seconds\": " << r.seconds
+			<< "}" << (i + 1 < results.size() ? "," : "") << "\n";
+	}
+	out << "  ]\n}\n";
+}
+
+/*
+Read back the result objects written by write_json. Only the flat objects of the "results" array are parsed, any
+other content of the file is ignored.
+*/
+std::vector<scaling_result> read_json(std::istream& in) {
+	std::string text((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+	std::vector<scaling_result> results;
+	auto array_start = text.find("\"results\"");
+	if (array_start == std::string::npos) {
+		return results;
+	}
+	std::regex object_regex("\\{([^{}]*)\\}");
+	std::regex field_regex("\"([a-z_]+)\"\\s*:\\s*(\"([^\"]*)\"|[-+0-9.eE]+)");
+	for (auto it = std::sregex_iterator(text.begin() + array_start, text.end(), object_regex);
+		 it != std::sregex_iterator();
+		 ++it) {
+		std::map<std::string, std::string> fields;
+		std::string body = (*it)[1];
+		for (auto f = std::sregex_iterator(body.begin(), body.end(), field_regex); f != std::sregex_iterator(); ++f) {
+			fields[(*f)[1]] = (*f)[3].matched ? (*f)[3].str() : (*f)[2].str();
+		}
+		auto number = [&fields](const char* key) { return std::strtod(fields[key].c_str(), nullptr); };
+		results.push_back({fields["curve"],
+			static_cast<size_t>(number("threads")),
+			static_cast<size_t>(number("jobs")),
+			static_cast<size_t>(number("n")),
+			static_cast<size_t>(number("k")),
+			static_cast<size_t>(number("dims")),
+			number("seconds")});
+	}
+	return results;
+}
+
+std::string result_key(const scaling_result& r) {
+	std::ostringstream key;
+	key << r.curve << " threads=" << r.threads << " jobs=" << r.jobs << " n=" << r.n << " k=" << r.k
+		<< " dims=" << r.dims;
+	return key.str();
+}
+
+/*
+Compare two result files, reporting every measurement that got slower by more than `threshold` (relative).
+Returns the number of regressions found.
+*/
+int compare_results(const std::string& baseline_path, const std::string& current_path, double threshold) {
+	std::ifstream baseline_file(baseline_path), current_file(current_path);
+	if (!baseline_file || !current_file) {
+		std::cerr << "Could not open " << (baseline_file ? current_path : baseline_path) << std::endl;
+		return -1;
+	}
+	std::map<std::string, double> baseline;
+	for (auto& r : read_json(baseline_file)) {
+		baseline[result_key(r)] = r.seconds;
+	}
+	int regressions = 0;
+	for (auto& r : read_json(current_file)) {
+		auto key = result_key(r);
+		auto found = baseline.find(key);
+		if (found == baseline.end()) {
+			std::cout << "new        " << key << std::endl;
+			continue;
+		}
+		double change = r.seconds / found->second - 1.0;
+		bool regressed = change > threshold;
+		regressions += regressed;
+		std::cout << (regressed ? "REGRESSION " : "ok         ") << key << " " << found->second * 1000.0 << "ms -> "
+				  << r.seconds * 1000.0 << "ms (" << (change >= 0 ? "+" : "") << change * 100.0 << "%)" << std::endl;
+	}
+	return regressions;
+}
+
+template <size_t N>
+double inertia(const std::vector<std::array<float, N>>& data,
+	const std::tuple<std::vector<std::array<float, N>>, std::vector<uint32_t>>& result) {
+	double total = 0.0;
+	for (size_t i = 0; i < data.size(); ++i) {
+		total += dkm::details::distance_squared(data[i], std::get<0>(result)[std::get<1>(result)[i]]);
+	}
+	return total;
+}
+
+/*
+Compare the LSH assignment of dkm::kmeans_lsh against the exact assignment of dkm::kmeans_lloyd on
+high-dimensional blobs, for a range of bit and table counts. Both start from the same k random points, since
+kmeans++ seeding would dominate the run time at this size, and run the same Lloyd iterations as the library
+functions. The inertia gap is relative to the exact clustering.
+*/
+int run_lsh() {
+	const size_t dims = 512, n = 20000;
+	const uint32_t k = 256;
+	const int iterations = 10;
+	typedef std::vector<std::array<float, dims>> points;
+	auto data = gaussian_blobs<dims>(n, k, 42);
+	points initial;
+	std::mt19937 engine(1);
+	std::uniform_int_distribution<size_t> pick(0, n - 1);
+	for (uint32_t j = 0; j < k; ++j) {
+		initial.push_back(data[pick(engine)]);
+	}
+	auto run = [&](const std::function<void(const points&, std::vector<uint32_t>&, int)>& assign, double& seconds) {
+		auto means = initial;
+		std::vector<uint32_t> labels;
+		auto start = std::chrono::high_resolution_clock::now();
+		for (int i = 0; i < iterations; ++i) {
+			assign(means, labels, i);
+			means = dkm::details::calculate_means(data, labels, means, k);
+		}
+		seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+		return inertia(data, std::make_tuple(means, dkm::details::calculate_clusters(data, means)));
+	};
+
+	double exact_seconds;
+	double exact_inertia = run(
+		[&](const points& means, std::vector<uint32_t>& labels, int) {
+			labels = dkm::details::calculate_clusters(data, means);
+		},
+		exact_seconds);
+	std::cout << "n=" << n << " k=" << k << " dims=" << dims << " iterations=" << iterations << std::endl;
+	std::cout << "exact                " << exact_seconds * 1000.0 << "ms" << std::endl;
+
+	const std::array<std::pair<uint32_t, uint32_t>, 5> settings{{{4, 4}, {6, 4}, {6, 8}, {8, 8}, {8, 16}}};
+	for (auto& setting : settings) {
+		double seconds;
+		dkm::details::sign_projection_hash<float, dims> hash(data, setting.first, setting.second, 1);
+		std::vector<uint32_t> codes(n * setting.second);
+		double lsh_inertia = run(
+			[&](const points& means, std::vector<uint32_t>& labels, int i) {
+				if (i == 0) {
+					for (size_t p = 0; p < n; ++p) {
+						hash.hash(data[p], &codes[p * setting.second]);
+					}
+					labels = dkm::details::calculate_clusters(data, means);
+				} else {
+					dkm::details::calculate_clusters_lsh(data, means, hash, codes, labels);
+				}
+			},
+			seconds);
+		std::cout << "lsh bits=" << setting.first << " tables=" << std::setw(2) << setting.second << "  "
+				  << seconds * 1000.0 << "ms speedup=" << exact_seconds / seconds
+				  << " inertia_gap=" << (lsh_inertia - exact_inertia) / exact_inertia << std::endl;
+	}
+	return 0;
+}
+
+/*
+Time every assignment step of equal-size k-means on imbalanced blobs, along with the number of points that changed
+cluster. The first step starts from the kmeans++ means with no prices and moves many points through the min-cost
+flow; the later ones start from the prices of the step before and should take a fraction of its time.
+*/
+int run_balanced() {
+	const size_t n = 200000;
+	const uint32_t k = 40;
+	const int iterations = 10;
+	datagen::spec s;
+	s.kind = datagen::shape::imbalanced;
+	s.n = n;
+	s.clusters = k;
+	s.seed = 42;
+	auto data = datagen::generate<float, 2>(s);
+	auto means = dkm::details::random_plusplus(data, k, 1);
+	std::vector<uint32_t> labels, previous;
+	std::vector<double> prices(k);
+	uint32_t candidates = 8;
+	std::cout << "n=" << n << " k=" << k << " sizes=" << n / k << std::endl;
+	for (int i = 0; i < iterations; ++i) {
+		auto start = std::chrono::high_resolution_clock::now();
+		labels = dkm::details::capacitated_assignment(data, means, n / k, n / k, candidates, labels, prices);
+		double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+		size_t moved = previous.empty() ? n : 0;
+		for (size_t p = 0; p < previous.size(); ++p) {
+			moved += labels[p] != previous[p];
+		}
+		std::cout << "iteration " << std::setw(2) << i << "  " << seconds * 1000.0 << "ms candidates=" << candidates
+				  << " moved=" << moved << std::endl;
+		previous = labels;
+		means = dkm::details::calculate_means(data, labels, means, k);
+	}
+	return 0;
+}
+
+int run_iris() {
 	std::cout << "# BEGINNING PROFILING #\n" << std::endl;
+#ifdef DKM_BENCH_OPENCV
 	auto cv_data = load_opencv();
 	auto time_opencv = profile_opencv(cv_data, 3);
+#endif
 	auto dkm_data = load_dkm();
 	auto time_dkm = profile_dkm(dkm_data, 3);
 
+#ifdef DKM_BENCH_OPENCV
 	std::cout << "OpenCV: "
 			  << std::chrono::duration_cast<std::chrono::duration<double, std::milli>>(time_opencv).count() << "ms"
 			  << std::endl;
+#endif
 	std::cout << "DKM: " << std::chrono::duration_cast<std::chrono::duration<double, std::milli>>(time_dkm).count()
 			  << "ms" << std::endl;
 
 	return 0;
-}
\ No newline at end of file
+}
+
+int main(int argc, char** argv) {
+	if (argc > 1 && std::strcmp(argv[1], "--scaling") == 0) {
+		std::string output;
+		size_t max_threads = std::max(1u, std::thread::hardware_concurrency());
+		for (int i = 2; i < argc; ++i) {
+			if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+				max_threads = std::max<size_t>(1, std::strtoul(argv[++i], nullptr, 10));
+			} else {
+				output = argv[i];
+			}
+		}
+		auto results = run_scaling(max_threads);
+		if (output.empty()) {
+			write_json(std::cout, results);
+		} else {
+			std::ofstream file(output);
+			write_json(file, results);
+		}
+		return 0;
+	}
+	if (argc > 3 && std::strcmp(argv[1], "--compare") == 0) {
+		double threshold = 0.1;
+		if (argc > 5 && std::strcmp(argv[4], "--threshold") == 0) {
+			threshold = std::strtod(argv[5], nullptr);
+		}
+		int regressions = compare_results(argv[2], argv[3], threshold);
+		return regressions == 0 ? 0 : 1;
+	}
+	if (argc > 1 && std::strcmp(argv[1], "--lsh") == 0) {
+		return run_lsh();
+	}
+	if (argc > 1 && std::strcmp(argv[1], "--balanced") == 0) {
+		return run_balanced();
+	}
+	return run_iris();
+}
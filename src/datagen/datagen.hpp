@@ -0,0 +1,341 @@
+#pragma once
+
+/*
+Reproducible synthetic data sets for the dkm benchmarks and tests.
+
+Points are generated in fixed-size blocks, each drawn from its own random engine seeded from the data set seed
+and the block index. The output therefore only depends on the `spec`, never on the number of threads used to
+produce it, and any range of points can be regenerated without generating the blocks before it.
+
+Binary files consist of a 64 byte `file_header` followed by the points as a row-major array of T, so they can be
+memory-mapped directly.
+*/
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <numeric>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace datagen {
+
+enum class shape {
+	// isotropic Gaussian clusters of equal size
+	gaussian,
+	// Gaussian clusters stretched and rotated by a random linear map each
+	anisotropic,
+	// isotropic Gaussian clusters whose sizes fall off geometrically
+	imbalanced,
+	// Gaussian clusters with a fraction of Student-t (2 degrees of freedom) outliers
+	heavy_tailed,
+	// Gaussian clusters in which a fraction of the points repeat an earlier point exactly
+	duplicates,
+	// Gaussian clusters in a random `rank` dimensional subspace plus a little isotropic noise
+	low_rank
+};
+
+struct spec {
+	shape kind = shape::gaussian;
+	uint64_t n = 0;
+	size_t dims = 2;
+	size_t clusters = 8;
+	uint64_t seed = 1;
+	// standard deviation of each cluster
+	double spread = 1.0;
+	// standard deviation of the cluster centres
+	double separation = 10.0;
+	// ratio between the sizes of consecutive clusters (imbalanced)
+	double imbalance = 0.5;
+	// fraction of outliers (heavy_tailed) or repeated points (duplicates)
+	double fraction = 0.2;
+	// dimension of the subspace the clusters live in (low_rank)
+	size_t rank = 4;
+	// worker threads, 0 selects std::thread::hardware_concurrency()
+	unsigned threads = 0;
+};
+
+// Number of points generated from a single random engine
+const uint64_t block_size = 16384;
+
+inline shape parse_shape(const std::string& name) {
+	if (name == "gaussian") {
+		return shape::gaussian;
+	} else if (name == "anisotropic") {
+		return shape::anisotropic;
+	} else if (name == "imbalanced") {
+		return shape::imbalanced;
+	} else if (name == "heavy_tailed") {
+		return shape::heavy_tailed;
+	} else if (name == "duplicates") {
+		return shape::duplicates;
+	} else if (name == "low_rank") {
+		return shape::low_rank;
+	}
+	throw std::invalid_argument("unknown data set shape: " + name);
+}
+
+/*
+The random model behind a data set (cluster centres, weights and linear maps), built once from the spec seed.
+*/
+class generator {
+public:
+	explicit generator(const spec& s) : spec_(s) {
+		if (s.dims == 0 || s.clusters == 0) {
+			throw std::invalid_argument("data sets need at least one dimension and one cluster");
+		}
+		std::mt19937_64 engine(s.seed);
+		std::normal_distribution<double> normal(0.0, 1.0);
+		latent_dims_ = s.kind == shape::low_rank ? std::min(std::max<size_t>(s.rank, 1), s.dims) : s.dims;
+
+		centres_.resize(s.clusters * latent_dims_);
+		for (auto& v : centres_) {
+			v = s.separation * normal(engine);
+		}
+
+		std::vector<double> weights(s.clusters, 1.0);
+		if (s.kind == shape::imbalanced) {
+			for (size_t c = 1; c < s.clusters; ++c) {
+				weights[c] = weights[c - 1] * s.imbalance;
+			}
+		}
+		cumulative_weights_.resize(s.clusters);
+		std::partial_sum(weights.begin(), weights.end(), cumulative_weights_.begin());
+		for (auto& w : cumulative_weights_) {
+			w /= cumulative_weights_.back();
+		}
+
+		if (s.kind == shape::anisotropic) {
+			maps_.resize(s.clusters * s.dims * s.dims);
+			for (auto& v : maps_) {
+				v = normal(engine) / std::sqrt(static_cast<double>(s.dims));
+			}
+		} else if (s.kind == shape::low_rank) {
+			maps_.resize(s.dims * latent_dims_);
+			for (auto& v : maps_) {
+				v = normal(engine) / std::sqrt(static_cast<double>(latent_dims_));
+			}
+		}
+	}
+
+	const spec& parameters() const { return spec_; }
+
+	/*
+	Generate the points [first, first + count) into `out` (count * dims values). Any range may be requested, a
+	block that is only partially covered is regenerated from its start.
+	*/
+	template <typename T>
+	void generate(uint64_t first, uint64_t count, T* out) const {
+		const size_t dims = spec_.dims;
+		std::vector<double> latent(latent_dims_);
+		uint64_t end = first + count;
+		uint64_t block = first / block_size;
+		while (first < end) {
+			uint64_t block_first = block * block_size;
+			uint64_t block_end = std::min(block_first + block_size, end);
+			std::seed_seq seq{static_cast<uint32_t>(spec_.seed),
+				static_cast<uint32_t>(spec_.seed >> 32),
+				static_cast<uint32_t>(block),
+				static_cast<uint32_t>(block >> 32)};
+			std::mt19937_64 engine(seq);
+			std::uniform_real_distribution<double> uniform(0.0, 1.0);
+			std::normal_distribution<double> normal(0.0, 1.0);
+			std::student_t_distribution<double> student(2.0);
+			// points only depend on the ones before them in the block, so the block is generated up to `end`
+			std::vector<T> block_points((block_end - block_first) * dims);
+			for (uint64_t i = 0; i < block_end - block_first; ++i) {
+				T* point = &block_points[i * dims];
+				if (spec_.kind == shape::duplicates && i > 0 && uniform(engine) < spec_.fraction) {
+					uint64_t source = std::min<uint64_t>(static_cast<uint64_t>(uniform(engine) * i), i - 1);
+					std::copy_n(&block_points[source * dims], dims, point);
+					continue;
+				}
+				size_t cluster = static_cast<size_t>(
+					std::lower_bound(cumulative_weights_.begin(), cumulative_weights_.end(), uniform(engine))
+					- cumulative_weights_.begin());
+				cluster = std::min(cluster, spec_.clusters - 1);
+				const double* centre = &centres_[cluster * latent_dims_];
+				bool outlier = spec_.kind == shape::heavy_tailed && uniform(engine) < spec_.fraction;
+				for (auto& v : latent) {
+					v = spec_.spread * (outlier ? student(engine) : normal(engine));
+				}
+				if (spec_.kind == shape::anisotropic) {
+					const double* map = &maps_[cluster * dims * dims];
+					for (size_t d = 0; d < dims; ++d) {
+						double value = centre[d];
+						for (size_t j = 0; j < dims; ++j) {
+							value += map[d * dims + j] * latent[j];
+						}
+						point[d] = static_cast<T>(value);
+					}
+				} else if (spec_.kind == shape::low_rank) {
+					for (size_t d = 0; d < dims; ++d) {
+						double value = 0.0;
+						for (size_t j = 0; j < latent_dims_; ++j) {
+							value += maps_[d * latent_dims_ + j] * (centre[j] + latent[j]);
+						}
+						point[d] = static_cast<T>(value + 0.01 * spec_.spread * normal(engine));
+					}
+				} else {
+					for (size_t d = 0; d < dims; ++d) {
+						point[d] = static_cast<T>(centre[d] + latent[d]);
+					}
+				}
+			}
+			out = std::copy(block_points.begin() + (first - block_first) * dims, block_points.end(), out);
+			first = block_end;
+			++block;
+		}
+	}
+
+private:
+	spec spec_;
+	size_t latent_dims_;
+	std::vector<double> centres_;
+	std::vector<double> cumulative_weights_;
+	std::vector<double> maps_;
+};
+
+namespace details {
+
+inline unsigned thread_count(const spec& s) {
+	unsigned threads = s.threads != 0 ? s.threads : std::thread::hardware_concurrency();
+	return std::max(1u, threads);
+}
+
+/*
+Call `f(first, count)` for every block of the data set, spreading the blocks over the spec's threads.
+*/
+template <typename F>
+void for_each_block(const spec& s, F&& f) {
+	uint64_t blocks = (s.n + block_size - 1) / block_size;
+	std::atomic<uint64_t> next(0);
+	auto worker = [&] {
+		for (uint64_t b = next++; b < blocks; b = next++) {
+			uint64_t first = b * block_size;
+			f(first, std::min(block_size, s.n - first));
+		}
+	};
+	std::vector<std::thread> workers;
+	for (unsigned t = 1; t < std::min<uint64_t>(thread_count(s), blocks); ++t) {
+		workers.emplace_back(worker);
+	}
+	worker();
+	for (auto& w : workers) {
+		w.join();
+	}
+}
+
+} // namespace details
+
+/*
+Header of a binary data set file. The points follow at `header_bytes`.
+*/
+struct file_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t value_bytes;
+	uint32_t floating_point;
+	uint32_t reserved;
+	uint64_t n;
+	uint64_t dims;
+	uint64_t header_bytes;
+	uint64_t padding[2];
+};
+static_assert(sizeof(file_header) == 64, "file_header must stay 64 bytes so the data remains aligned");
+
+const char file_magic[8] = {'D', 'K', 'M', 'D', 'A', 'T', 'A', '\0'};
+
+/*
+Generate a data set in memory.
+*/
+template <typename T, size_t N>
+std::vector<std::array<T, N>> generate(spec s) {
+	static_assert(sizeof(std::array<T, N>) == N * sizeof(T), "points are written as a contiguous array of T");
+	s.dims = N;
+	generator gen(s);
+	std::vector<std::array<T, N>> points(s.n);
+	details::for_each_block(
+		s, [&](uint64_t first, uint64_t count) { gen.generate(first, count, points[first].data()); });
+	return points;
+}
+
+/*
+Generate a data set straight into a binary file. Every worker thread writes its blocks at their final offset
+through its own stream, so memory use is bounded by one block per thread regardless of the file size.
+*/
+template <typename T>
+void write_file(const spec& s, const std::string& path) {
+	static_assert(std::is_arithmetic<T>::value, "data sets hold arithmetic values");
+	generator gen(s);
+	file_header header{};
+	std::memcpy(header.magic, file_magic, sizeof(file_magic));
+	header.version = 1;
+	header.value_bytes = sizeof(T);
+	header.floating_point = std::is_floating_point<T>::value;
+	header.n = s.n;
+	header.dims = s.dims;
+	header.header_bytes = sizeof(file_header);
+	const uint64_t point_bytes = s.dims * sizeof(T);
+	{
+		std::ofstream file(path, std::ios::binary | std::ios::trunc);
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		// extend the file to its final size so that workers can write anywhere in it
+		if (s.n > 0) {
+			file.seekp(static_cast<std::streamoff>(sizeof(header) + s.n * point_bytes - 1));
+			file.put('\0');
+		}
+		if (!file) {
+			throw std::runtime_error("could not create " + path);
+		}
+	}
+	std::atomic<bool> failed(false);
+	details::for_each_block(s, [&](uint64_t first, uint64_t count) {
+		thread_local std::vector<T> buffer;
+		buffer.resize(count * s.dims);
+		gen.generate(first, count, buffer.data());
+		std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+		file.seekp(static_cast<std::streamoff>(sizeof(header) + first * point_bytes));
+		file.write(reinterpret_cast<const char*>(buffer.data()), static_cast<std::streamsize>(count * point_bytes));
+		if (!file) {
+			failed = true;
+		}
+	});
+	if (failed) {
+		throw std::runtime_error("could not write " + path);
+	}
+}
+
+/*
+Load a binary data set file written by write_file. Throws if the file doesn't hold N-dimensional values of type T.
+*/
+template <typename T, size_t N>
+std::vector<std::array<T, N>> read_file(const std::string& path) {
+	std::ifstream file(path, std::ios::binary);
+	file_header header{};
+	file.read(reinterpret_cast<char*>(&header), sizeof(header));
+	if (!file || std::memcmp(header.magic, file_magic, sizeof(file_magic)) != 0) {
+		throw std::runtime_error(path + " is not a dkm data set");
+	}
+	if (header.value_bytes != sizeof(T) || header.floating_point != std::is_floating_point<T>::value
+		|| header.dims != N) {
+		throw std::runtime_error(path + " holds a different value type or dimension");
+	}
+	std::vector<std::array<T, N>> points(header.n);
+	file.seekg(static_cast<std::streamoff>(header.header_bytes));
+	file.read(reinterpret_cast<char*>(points.data()), static_cast<std::streamsize>(header.n * sizeof(T) * N));
+	if (!file) {
+		throw std::runtime_error(path + " is truncated");
+	}
+	return points;
+}
+
+} // namespace datagen
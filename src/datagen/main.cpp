@@ -0,0 +1,90 @@
+/*
+Command line front end of datagen.hpp, writing a synthetic data set to a binary file.
+*/
+
+#include "datagen.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+namespace {
+
+void usage() {
+	std::cerr << "Usage: dkm_datagen --out FILE [options]\n"
+				 "  --shape S        gaussian, anisotropic, imbalanced, heavy_tailed, duplicates or low_rank\n"
+				 "  --n N            number of points\n"
+				 "  --dims D         dimension of each point\n"
+				 "  --clusters K     number of clusters\n"
+				 "  --seed S         random seed\n"
+				 "  --type T         float or double\n"
+				 "  --spread X       standard deviation of each cluster\n"
+				 "  --separation X   standard deviation of the cluster centres\n"
+				 "  --imbalance X    size ratio of consecutive clusters (imbalanced)\n"
+				 "  --fraction X     fraction of outliers or duplicates\n"
+				 "  --rank R         dimension of the cluster subspace (low_rank)\n"
+				 "  --threads T      worker threads (0 for all cores)"
+			  << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+	datagen::spec s;
+	std::string out;
+	std::string type = "float";
+	try {
+		for (int i = 1; i < argc; ++i) {
+			std::string arg = argv[i];
+			if (i + 1 >= argc) {
+				usage();
+				return 1;
+			}
+			const char* value = argv[++i];
+			if (arg == "--out") {
+				out = value;
+			} else if (arg == "--shape") {
+				s.kind = datagen::parse_shape(value);
+			} else if (arg == "--n") {
+				s.n = std::strtoull(value, nullptr, 10);
+			} else if (arg == "--dims") {
+				s.dims = std::strtoul(value, nullptr, 10);
+			} else if (arg == "--clusters") {
+				s.clusters = std::strtoul(value, nullptr, 10);
+			} else if (arg == "--seed") {
+				s.seed = std::strtoull(value, nullptr, 10);
+			} else if (arg == "--type") {
+				type = value;
+			} else if (arg == "--spread") {
+				s.spread = std::strtod(value, nullptr);
+			} else if (arg == "--separation") {
+				s.separation = std::strtod(value, nullptr);
+			} else if (arg == "--imbalance") {
+				s.imbalance = std::strtod(value, nullptr);
+			} else if (arg == "--fraction") {
+				s.fraction = std::strtod(value, nullptr);
+			} else if (arg == "--rank") {
+				s.rank = std::strtoul(value, nullptr, 10);
+			} else if (arg == "--threads") {
+				s.threads = static_cast<unsigned>(std::strtoul(value, nullptr, 10));
+			} else {
+				usage();
+				return 1;
+			}
+		}
+		if (out.empty() || (type != "float" && type != "double")) {
+			usage();
+			return 1;
+		}
+		if (type == "float") {
+			datagen::write_file<float>(s, out);
+		} else {
+			datagen::write_file<double>(s, out);
+		}
+	} catch (const std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
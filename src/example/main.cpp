@@ -9,7 +9,7 @@
 
 int main() {
 	std::vector<std::array<float, 2>> data{{1.f, 1.f}, {2.f, 2.f}, {1200.f, 1200.f}, {2.f, 2.f}};
-	auto cluster_data = dkm::kmeans_lloyd(data, 2);
+	auto cluster_data = dkm::kmeans_lloyd(data, 2, 100);
 
 	std::cout << "Means:" << std::endl;
 	for (const auto& mean : std::get<0>(cluster_data)) {
@@ -0,0 +1,98 @@
+/*
+Definitions of the dkm::lib::kmeans_lloyd specialisations declared in dkm_lib.hpp. They run the header's iterations,
+compiled for the baseline instruction set like everything else here, except for the naive assignment step, which
+goes to the kernels of the best instruction set the CPU supports (see kernels.cpp) when there are enough means and
+dimensions for them to pay off.
+*/
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <tuple>
+#include <vector>
+
+#include "../../include/dkm_lib.hpp"
+#include "kernels.hpp"
+
+namespace dkm_lib {
+
+namespace {
+
+const char* const isa_names[] = {"baseline", "avx2", "avx512"};
+
+isa detect_isa() {
+	if (supports(isa::avx512)) {
+		return isa::avx512;
+	}
+	if (supports(isa::avx2)) {
+		return isa::avx2;
+	}
+	return isa::baseline;
+}
+
+std::atomic<int>& selected_isa() {
+	static std::atomic<int> selected(static_cast<int>(detect_isa()));
+	return selected;
+}
+
+// Smallest number of dimensions times means for which the vector kernels measured faster than the header's loop,
+// which unlike them skips padding lanes and abandons distances early
+const size_t vector_min_work = 256;
+
+/*
+dkm::details::calculate_clusters with the kernel of the selected instruction set.
+*/
+template <typename T, size_t N>
+std::vector<uint32_t> calculate_clusters(
+	const std::vector<std::array<T, N>>& data, const std::vector<std::array<T, N>>& means) {
+	static_assert(sizeof(std::array<T, N>) == N * sizeof(T), "the points must be contiguous arrays of values");
+	const auto kernel = closest_means_kernel(static_cast<isa>(selected_isa().load()), T());
+	const size_t k = means.size();
+	if (kernel == nullptr || N * k < vector_min_work || data.empty()) {
+		return dkm::details::calculate_clusters(data, means);
+	}
+	const size_t stride = (k + means_alignment - 1) / means_alignment * means_alignment;
+	std::vector<T> transposed(N * stride, T());
+	for (size_t j = 0; j < k; ++j) {
+		for (size_t d = 0; d < N; ++d) {
+			transposed[d * stride + j] = means[j][d];
+		}
+	}
+	std::vector<uint32_t> labels(data.size());
+	kernel(data.front().data(), data.size(), N, transposed.data(), k, stride, labels.data());
+	return labels;
+}
+
+} // namespace
+} // namespace dkm_lib
+
+#define DKM_LIB_DEFINE_KMEANS_LLOYD(T, N)                                                                        \
+	template <>                                                                                                  \
+	std::tuple<std::vector<std::array<T, N>>, std::vector<uint32_t>> kmeans_lloyd<T, N>(                         \
+		const std::vector<std::array<T, N>>& data, uint32_t k, int maxIter, int seed, float epsilon,             \
+		assignment method) {                                                                                     \
+		return details::lloyd(data, k, maxIter, seed, epsilon, method, &dkm_lib::calculate_clusters<T, N>);      \
+	}
+
+namespace dkm {
+
+namespace lib {
+
+DKM_LIB_INSTANCES(DKM_LIB_DEFINE_KMEANS_LLOYD)
+
+} // namespace lib
+
+const char* library_isa() { return dkm_lib::isa_names[dkm_lib::selected_isa().load()]; }
+
+bool select_library_isa(const char* name) {
+	for (int set = 0; set < 3; ++set) {
+		if (std::strcmp(name, dkm_lib::isa_names[set]) == 0 && dkm_lib::supports(static_cast<dkm_lib::isa>(set))) {
+			dkm_lib::selected_isa().store(set);
+			return true;
+		}
+	}
+	return false;
+}
+
+} // namespace dkm
@@ -0,0 +1,192 @@
+/*
+The closest mean kernels of libdkm for AVX2 and AVX-512.
+
+Both compare a point with a block of means at a time, one mean per vector lane, summing the squared differences
+dimension by dimension with separate multiplies and adds. Each lane therefore rounds exactly like
+dkm::details::distance_squared, and the labels are the header's bit for bit. The kernels are compiled for their
+instruction set with function attributes, have internal linkage and use no standard library templates, so only
+they contain instructions the baseline may not support.
+*/
+
+#include "kernels.hpp"
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define DKM_LIB_X86
+#include <immintrin.h>
+#endif
+
+namespace dkm_lib {
+
+namespace {
+
+// Number of means compared at once, which the rows of the transposed means are padded to
+const size_t block = means_alignment;
+
+/*
+Fold the distances to means first .. first + count - 1 into the closest mean found so far, lowest index on ties.
+*/
+template <typename T>
+inline void choose(const T* distances, size_t first, size_t count, T& smallest, uint32_t& index) {
+	for (size_t l = 0; l < count; ++l) {
+		if (first + l == 0 || distances[l] < smallest) {
+			smallest = distances[l];
+			index = static_cast<uint32_t>(first + l);
+		}
+	}
+}
+
+inline size_t block_size(size_t first, size_t k) { return k - first < block ? k - first : block; }
+
+#ifdef DKM_LIB_X86
+
+__attribute__((target("avx2"))) void closest_means_avx2(
+	const float* points, size_t n, size_t dims, const float* means, size_t k, size_t stride, uint32_t* labels) {
+	alignas(32) float distances[block];
+	for (size_t i = 0; i < n; ++i, points += dims) {
+		float smallest = 0.0f;
+		uint32_t index = 0;
+		for (size_t first = 0; first < k; first += block) {
+			__m256 a = _mm256_setzero_ps(), b = _mm256_setzero_ps();
+			const float* row = means + first;
+			for (size_t d = 0; d < dims; ++d, row += stride) {
+				const __m256 p = _mm256_set1_ps(points[d]);
+				const __m256 da = _mm256_sub_ps(p, _mm256_loadu_ps(row));
+				const __m256 db = _mm256_sub_ps(p, _mm256_loadu_ps(row + 8));
+				a = _mm256_add_ps(a, _mm256_mul_ps(da, da));
+				b = _mm256_add_ps(b, _mm256_mul_ps(db, db));
+			}
+			_mm256_store_ps(distances, a);
+			_mm256_store_ps(distances + 8, b);
+			choose(distances, first, block_size(first, k), smallest, index);
+		}
+		labels[i] = index;
+	}
+}
+
+__attribute__((target("avx2"))) void closest_means_avx2(
+	const double* points, size_t n, size_t dims, const double* means, size_t k, size_t stride, uint32_t* labels) {
+	alignas(32) double distances[block];
+	for (size_t i = 0; i < n; ++i, points += dims) {
+		double smallest = 0.0;
+		uint32_t index = 0;
+		for (size_t first = 0; first < k; first += block) {
+			__m256d a = _mm256_setzero_pd(), b = _mm256_setzero_pd(), c = _mm256_setzero_pd(),
+					e = _mm256_setzero_pd();
+			const double* row = means + first;
+			for (size_t d = 0; d < dims; ++d, row += stride) {
+				const __m256d p = _mm256_set1_pd(points[d]);
+				const __m256d da = _mm256_sub_pd(p, _mm256_loadu_pd(row));
+				const __m256d db = _mm256_sub_pd(p, _mm256_loadu_pd(row + 4));
+				const __m256d dc = _mm256_sub_pd(p, _mm256_loadu_pd(row + 8));
+				const __m256d de = _mm256_sub_pd(p, _mm256_loadu_pd(row + 12));
+				a = _mm256_add_pd(a, _mm256_mul_pd(da, da));
+				b = _mm256_add_pd(b, _mm256_mul_pd(db, db));
+				c = _mm256_add_pd(c, _mm256_mul_pd(dc, dc));
+				e = _mm256_add_pd(e, _mm256_mul_pd(de, de));
+			}
+			_mm256_store_pd(distances, a);
+			_mm256_store_pd(distances + 4, b);
+			_mm256_store_pd(distances + 8, c);
+			_mm256_store_pd(distances + 12, e);
+			choose(distances, first, block_size(first, k), smallest, index);
+		}
+		labels[i] = index;
+	}
+}
+
+__attribute__((target("avx512f"))) void closest_means_avx512(
+	const float* points, size_t n, size_t dims, const float* means, size_t k, size_t stride, uint32_t* labels) {
+	alignas(64) float distances[block];
+	for (size_t i = 0; i < n; ++i, points += dims) {
+		float smallest = 0.0f;
+		uint32_t index = 0;
+		for (size_t first = 0; first < k; first += block) {
+			__m512 a = _mm512_setzero_ps();
+			const float* row = means + first;
+			for (size_t d = 0; d < dims; ++d, row += stride) {
+				const __m512 da = _mm512_sub_ps(_mm512_set1_ps(points[d]), _mm512_loadu_ps(row));
+				a = _mm512_add_ps(a, _mm512_mul_ps(da, da));
+			}
+			_mm512_store_ps(distances, a);
+			choose(distances, first, block_size(first, k), smallest, index);
+		}
+		labels[i] = index;
+	}
+}
+
+__attribute__((target("avx512f"))) void closest_means_avx512(
+	const double* points, size_t n, size_t dims, const double* means, size_t k, size_t stride, uint32_t* labels) {
+	alignas(64) double distances[block];
+	for (size_t i = 0; i < n; ++i, points += dims) {
+		double smallest = 0.0;
+		uint32_t index = 0;
+		for (size_t first = 0; first < k; first += block) {
+			__m512d a = _mm512_setzero_pd(), b = _mm512_setzero_pd();
+			const double* row = means + first;
+			for (size_t d = 0; d < dims; ++d, row += stride) {
+				const __m512d p = _mm512_set1_pd(points[d]);
+				const __m512d da = _mm512_sub_pd(p, _mm512_loadu_pd(row));
+				const __m512d db = _mm512_sub_pd(p, _mm512_loadu_pd(row + 8));
+				a = _mm512_add_pd(a, _mm512_mul_pd(da, da));
+				b = _mm512_add_pd(b, _mm512_mul_pd(db, db));
+			}
+			_mm512_store_pd(distances, a);
+			_mm512_store_pd(distances + 8, b);
+			choose(distances, first, block_size(first, k), smallest, index);
+		}
+		labels[i] = index;
+	}
+}
+
+#endif
+
+} // namespace
+
+bool supports(isa set) {
+#ifdef DKM_LIB_X86
+	__builtin_cpu_init();
+	switch (set) {
+	case isa::avx512:
+		return __builtin_cpu_supports("avx512f");
+	case isa::avx2:
+		return __builtin_cpu_supports("avx2");
+	case isa::baseline:
+		break;
+	}
+#endif
+	return set == isa::baseline;
+}
+
+closest_means_float closest_means_kernel(isa set, float) {
+#ifdef DKM_LIB_X86
+	switch (set) {
+	case isa::avx512:
+		return &closest_means_avx512;
+	case isa::avx2:
+		return &closest_means_avx2;
+	case isa::baseline:
+		break;
+	}
+#else
+	(void)set;
+#endif
+	return nullptr;
+}
+
+closest_means_double closest_means_kernel(isa set, double) {
+#ifdef DKM_LIB_X86
+	switch (set) {
+	case isa::avx512:
+		return &closest_means_avx512;
+	case isa::avx2:
+		return &closest_means_avx2;
+	case isa::baseline:
+		break;
+	}
+#else
+	(void)set;
+#endif
+	return nullptr;
+}
+
+} // namespace dkm_lib
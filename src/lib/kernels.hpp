@@ -0,0 +1,35 @@
+#pragma once
+
+/*
+The instruction set specific kernels of libdkm. They take plain arrays and use no standard library templates, so
+nothing compiled for AVX2 or AVX-512 can end up shared with, and called from, the baseline code.
+*/
+
+#include <cstddef>
+#include <cstdint>
+
+namespace dkm_lib {
+
+enum class isa { baseline, avx2, avx512 };
+
+/*
+Label every one of the n points of `dims` values each with the index of its closest of k means, lowest index on
+ties, exactly as dkm::details::closest_mean does. The means are transposed: value d of mean j is
+means[d * stride + j], where stride is a multiple of 16 no smaller than k.
+*/
+typedef void (*closest_means_float)(
+	const float* points, size_t n, size_t dims, const float* means, size_t k, size_t stride, uint32_t* labels);
+typedef void (*closest_means_double)(
+	const double* points, size_t n, size_t dims, const double* means, size_t k, size_t stride, uint32_t* labels);
+
+// the stride of the transposed means is the number of means rounded up to a multiple of this
+const size_t means_alignment = 16;
+
+// whether the CPU can run the kernels of an instruction set
+bool supports(isa set);
+
+// the kernel of an instruction set, null for the baseline, which uses dkm::details::calculate_clusters
+closest_means_float closest_means_kernel(isa set, float);
+closest_means_double closest_means_kernel(isa set, double);
+
+} // namespace dkm_lib
@@ -0,0 +1,103 @@
+/*
+Micro-benchmark of libdkm's instruction set variants
+
+Times ten Lloyd iterations of the header templates and of libdkm's kmeans_lloyd with every instruction set the CPU
+supports, over T, N and k, and reports the speed-up of each over the header. The labels of all variants are
+checked to be the same as the header's.
+
+Usage: dkm_microbench_lib
+*/
+
+#include "../../include/dkm_lib.hpp"
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <tuple>
+#include <vector>
+
+namespace {
+
+const size_t points = 50000;
+const int iterations = 10;
+
+template <typename T>
+const char* type_name();
+template <>
+const char* type_name<float>() {
+	return "float";
+}
+template <>
+const char* type_name<double>() {
+	return "double";
+}
+
+template <typename F>
+double seconds(F&& f) {
+	auto start = std::chrono::high_resolution_clock::now();
+	f();
+	return std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+template <typename T, size_t N>
+void bench(uint32_t k) {
+	std::mt19937 engine(42);
+	std::normal_distribution<T> normal(T(0), T(10));
+	std::vector<std::array<T, N>> data(points);
+	for (auto& p : data) {
+		for (auto& v : p) {
+			v = normal(engine);
+		}
+	}
+	std::tuple<std::vector<std::array<T, N>>, std::vector<uint32_t>> header, library;
+	// epsilon -1 runs all iterations
+	double reference = seconds([&] {
+		header = dkm::kmeans_lloyd(data, k, iterations, 1, -1.0f);
+	});
+	std::cout << std::left << std::setw(8) << type_name<T>() << std::right << std::setw(5) << N << std::setw(6) << k
+			  << std::fixed << std::setprecision(3) << std::setw(10) << reference;
+	for (const char* isa : {"baseline", "avx2", "avx512"}) {
+		if (!dkm::select_library_isa(isa)) {
+			std::cout << std::setw(18) << "-";
+			continue;
+		}
+		double s = seconds([&] { library = dkm::lib::kmeans_lloyd(data, k, iterations, 1, -1.0f); });
+		std::cout << std::setw(10) << s << std::setw(6) << std::setprecision(1) << reference / s << "x"
+				  << (library == header ? " " : "!") << std::setprecision(3);
+	}
+	std::cout << std::endl;
+	std::cout.unsetf(std::ios::fixed);
+}
+
+template <typename T, size_t N>
+void bench_cluster_counts() {
+	bench<T, N>(4);
+	bench<T, N>(32);
+	bench<T, N>(256);
+}
+
+template <typename T>
+void bench_dimensions() {
+	bench_cluster_counts<T, 2>();
+	bench_cluster_counts<T, 16>();
+	bench_cluster_counts<T, 128>();
+}
+
+} // namespace
+
+int main() {
+	const std::string detected = dkm::library_isa();
+	std::cout << "Seconds for " << iterations << " iterations over " << points << " points, detected " << detected
+			  << " ('!' marks labels differing from the header)" << std::endl;
+	std::cout << std::left << std::setw(8) << "T" << std::right << std::setw(5) << "N" << std::setw(6) << "k"
+			  << std::setw(10) << "header" << std::setw(18) << "baseline" << std::setw(18) << "avx2" << std::setw(18)
+			  << "avx512" << std::endl;
+	bench_dimensions<float>();
+	bench_dimensions<double>();
+	dkm::select_library_isa(detected.c_str());
+	return 0;
+}
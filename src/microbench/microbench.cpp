@@ -0,0 +1,265 @@
+/*
+Per-kernel micro-benchmarks for dkm.hpp and dkm_utils.hpp
+
+Every kernel is timed in isolation across value types (T), dimensions (N) and cluster counts (k). Results are
+reported in nanoseconds per point and in GB/s of point data streamed, next to the sustained read bandwidth of
+the machine measured at start-up. A kernel running close to that roofline is bandwidth-bound, one well below it
+is compute-bound.
+
+Usage: dkm_microbench [kernel-name-filter]
+*/
+
+#include "../../include/dkm.hpp"
+#include "../../include/dkm_utils.hpp"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <numeric>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Size of the point data set used for streaming kernels, large enough to spill out of the last level cache
+const size_t data_bytes = 32u << 20;
+// Minimum amount of time spent repeating each kernel
+const double min_seconds = 0.2;
+
+volatile double sink;
+
+template <typename T>
+const char* type_name();
+template <>
+const char* type_name<float>() {
+	return "float";
+}
+template <>
+const char* type_name<double>() {
+	return "double";
+}
+
+template <typename F>
+double seconds_per_call(F&& f) {
+	size_t calls = 0;
+	auto start = std::chrono::high_resolution_clock::now();
+	double elapsed = 0.0;
+	do {
+		f();
+		++calls;
+		elapsed = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+	} while (elapsed < min_seconds);
+	return elapsed / calls;
+}
+
+/*
+Sustained read bandwidth in GB/s, measured by summing a buffer several times the size of the benchmark data.
+*/
+double measure_bandwidth() {
+	std::vector<double> buffer(4 * data_bytes / sizeof(double), 1.0);
+	double seconds = seconds_per_call([&] {
+		double a = 0.0, b = 0.0, c = 0.0, d = 0.0;
+		for (size_t i = 0; i + 3 < buffer.size(); i += 4) {
+			a += buffer[i];
+			b += buffer[i + 1];
+			c += buffer[i + 2];
+			d += buffer[i + 3];
+		}
+		sink = a + b + c + d;
+	});
+	return static_cast<double>(buffer.size() * sizeof(double)) / seconds / 1e9;
+}
+
+struct report {
+	std::string filter;
+	double bandwidth;
+
+	/*
+	Print one result row. `bytes` is the amount of point data the kernel has to stream per call, `points` the
+	number of points it processes per call.
+	*/
+	void row(const char* kernel, const char* type, size_t n_dims, uint32_t k, size_t points, double bytes,
+		double seconds) const {
+		double gbps = bytes / seconds / 1e9;
+		std::cout << std::left << std::setw(26) << kernel << std::right << std::setw(7) << type << std::setw(6)
+				  << n_dims << std::setw(6) << k << std::setw(10) << points << std::fixed << std::setprecision(2)
+				  << std::setw(12) << seconds * 1e9 / points << std::setw(10) << gbps << std::setw(8)
+				  << 100.0 * gbps / bandwidth << "%" << std::setw(11) << (gbps > 0.6 * bandwidth ? "memory" : "compute")
+				  << std::endl;
+		std::cout.unsetf(std::ios::fixed);
+	}
+
+	bool wants(const char* kernel) const {
+		return filter.empty() || std::string(kernel).find(filter) != std::string::npos;
+	}
+};
+
+template <typename T, size_t N>
+std::vector<std::array<T, N>> random_points(size_t n, std::mt19937& engine) {
+	std::normal_distribution<T> normal(T(0), T(10));
+	std::vector<std::array<T, N>> points(n);
+	for (auto& p : points) {
+		for (auto& v : p) {
+			v = normal(engine);
+		}
+	}
+	return points;
+}
+
+/*
+Number of points dkm::details::random_plusplus reads to pick `means` from `data`: all of them for the first mean,
+then for every added mean those that its triangle inequality test doesn't skip, i.e. whose closest mean is less
+than twice their distance to it away from the added one. A skipped group only holds such points, since its radius
+bounds its members' distances. The last mean is picked but never compared with.
+*/
+template <typename T, size_t N>
+double plusplus_reads(const std::vector<std::array<T, N>>& data, const std::vector<std::array<T, N>>& means) {
+	// the margin random_plusplus allows for rounding
+	const double margin = 4.0 * (1.0 + 8.0 * (N + 2) * static_cast<double>(std::numeric_limits<T>::epsilon()));
+	std::vector<T> distances(data.size());
+	std::vector<uint32_t> closest(data.size(), 0);
+	for (size_t i = 0; i < data.size(); ++i) {
+		distances[i] = dkm::details::distance_squared(data[i], means[0]);
+	}
+	double reads = static_cast<double>(data.size());
+	std::vector<double> centres;
+	for (uint32_t added = 1; added + 1 < means.size(); ++added) {
+		centres.assign(added, 0.0);
+		for (uint32_t j = 0; j < added; ++j) {
+			for (size_t d = 0; d < N; ++d) {
+				double delta = static_cast<double>(means[j][d]) - static_cast<double>(means[added][d]);
+				centres[j] += delta * delta;
+			}
+		}
+		for (size_t i = 0; i < data.size(); ++i) {
+			if (centres[closest[i]] < margin * static_cast<double>(distances[i])) {
+				++reads;
+				T d = dkm::details::distance_squared(data[i], means[added]);
+				if (d < distances[i]) {
+					distances[i] = d;
+					closest[i] = added;
+				}
+			}
+		}
+	}
+	return reads;
+}
+
+template <typename T, size_t N>
+void bench_kernels(const report& out, uint32_t k, bool run_k_independent) {
+	std::mt19937 engine(42);
+	const size_t n = data_bytes / sizeof(std::array<T, N>);
+	const double point_bytes = static_cast<double>(n * sizeof(std::array<T, N>));
+	const double label_bytes = static_cast<double>(n * sizeof(uint32_t));
+	auto data = random_points<T, N>(n, engine);
+	auto means = random_points<T, N>(k, engine);
+	auto other_means = random_points<T, N>(k, engine);
+	auto clusters = dkm::details::calculate_clusters(data, means);
+	const char* type = type_name<T>();
+
+	if (run_k_independent && out.wants("distance_squared")) {
+		auto& point = means[0];
+		double s = seconds_per_call([&] {
+			T total = T();
+			for (auto& p : data) {
+				total += dkm::details::distance_squared(p, point);
+			}
+			sink = total;
+		});
+		out.row("distance_squared", type, N, k, n, point_bytes, s);
+	}
+	if (out.wants("closest_mean")) {
+		double s = seconds_per_call([&] {
+			uint64_t total = 0;
+			for (auto& p : data) {
+				total += dkm::details::closest_mean(p, means);
+			}
+			sink = static_cast<double>(total);
+		});
+		out.row("closest_mean", type, N, k, n, point_bytes, s);
+	}
+	if (out.wants("closest_distance")) {
+		double s = seconds_per_call([&] { sink = dkm::details::closest_distance(means, data, k).back(); });
+		out.row("closest_distance", type, N, k, n, point_bytes + n * sizeof(T), s);
+	}
+	if (out.wants("calculate_clusters")) {
+		double s = seconds_per_call([&] { sink = dkm::details::calculate_clusters(data, means).back(); });
+		out.row("calculate_clusters", type, N, k, n, point_bytes + label_bytes, s);
+	}
+	if (out.wants("calculate_means")) {
+		double s =
+			seconds_per_call([&] { sink = dkm::details::calculate_means(data, clusters, means, k).back()[0]; });
+		out.row("calculate_means", type, N, k, n, point_bytes + label_bytes, s);
+	}
+	// kmeans++ compares the points with each mean but the last, skipping those the triangle inequality rules out
+	if (out.wants("random_plusplus") && k <= 32) {
+		double s = seconds_per_call([&] { sink = dkm::details::random_plusplus(data, k, 1).back()[0]; });
+		double reads = plusplus_reads(data, dkm::details::random_plusplus(data, k, 1));
+		out.row("random_plusplus", type, N, k, n, reads * sizeof(std::array<T, N>), s);
+	}
+	if (out.wants("point_collection_epsilon")) {
+		double s = seconds_per_call([&] { sink = dkm::details::point_collection_epsilon(means, other_means); });
+		out.row("point_collection_epsilon", type, N, k, k, 2.0 * k * sizeof(std::array<T, N>), s);
+	}
+	if (run_k_independent && out.wants("dist_to_center")) {
+		double s = seconds_per_call([&] { sink = dkm::dist_to_center(data, means[0]).back(); });
+		out.row("dist_to_center", type, N, k, n, point_bytes + n * sizeof(T), s);
+	}
+	if (run_k_independent && out.wants("sum_dist")) {
+		double s = seconds_per_call([&] { sink = dkm::sum_dist(data, means[0]); });
+		out.row("sum_dist", type, N, k, n, point_bytes + n * sizeof(T), s);
+	}
+	// get_cluster scans every label but only touches the points of the requested cluster
+	if (out.wants("get_cluster")) {
+		auto members = static_cast<double>(std::count(clusters.begin(), clusters.end(), 0u));
+		double s =
+			seconds_per_call([&] { sink = static_cast<double>(dkm::get_cluster(data, clusters, 0).size()); });
+		out.row("get_cluster", type, N, k, n, label_bytes + members * sizeof(std::array<T, N>), s);
+	}
+	// means_inertia gathers each cluster separately and so scans the labels once per cluster
+	if (out.wants("means_inertia")) {
+		auto result = std::make_tuple(means, clusters);
+		double s = seconds_per_call([&] { sink = dkm::means_inertia(data, result, k); });
+		out.row("means_inertia", type, N, k, n, point_bytes + label_bytes * k, s);
+	}
+	// two restarts of ten Lloyd iterations each, every iteration streams the data twice
+	if (out.wants("get_best_means") && k <= 32) {
+		double s = seconds_per_call([&] { sink = std::get<0>(dkm::get_best_means(data, k, 2, 10)).back()[0]; });
+		out.row("get_best_means", type, N, k, n, 2.0 * 10 * 2 * (point_bytes + label_bytes), s);
+	}
+}
+
+template <typename T, size_t N>
+void bench_cluster_counts(const report& out) {
+	// kernels that don't depend on k are only measured once per dimension
+	bench_kernels<T, N>(out, 4, true);
+	bench_kernels<T, N>(out, 32, false);
+	bench_kernels<T, N>(out, 256, false);
+}
+
+template <typename T>
+void bench_dimensions(const report& out) {
+	bench_cluster_counts<T, 2>(out);
+	bench_cluster_counts<T, 16>(out);
+	bench_cluster_counts<T, 128>(out);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+	report out;
+	out.filter = argc > 1 ? argv[1] : "";
+	out.bandwidth = measure_bandwidth();
+	std::cout << "Sustained read bandwidth: " << out.bandwidth << " GB/s" << std::endl;
+	std::cout << std::left << std::setw(26) << "kernel" << std::right << std::setw(7) << "T" << std::setw(6) << "N"
+			  << std::setw(6) << "k" << std::setw(10) << "points" << std::setw(12) << "ns/point" << std::setw(10)
+			  << "GB/s" << std::setw(9) << "roof" << std::setw(11) << "bound" << std::endl;
+	bench_dimensions<float>(out);
+	bench_dimensions<double>(out);
+	return 0;
+}
@@ -7,7 +7,27 @@ This is just simple test harness without any external dependencies.
 */
 
 #include "../../include/dkm.hpp"
+#ifdef DKM_TEST_LIBRARY
+#include "../../include/dkm_lib.hpp"
+#endif
 #include "../../include/dkm_utils.hpp"
+#include "../../include/dkm_1d.hpp"
+#include "../../include/dkm_balanced.hpp"
+#include "../../include/dkm_binary.hpp"
+#include "../../include/dkm_dynamic.hpp"
+#include "../../include/dkm_fuzzy.hpp"
+#include "../../include/dkm_gmm.hpp"
+#include "../../include/dkm_grid.hpp"
+#include "../../include/dkm_histogram.hpp"
+#include "../../include/dkm_kernel.hpp"
+#include "../../include/dkm_lsh.hpp"
+#include "../../include/dkm_merge.hpp"
+#include "../../include/dkm_pipeline.hpp"
+#include "../../include/dkm_predict.hpp"
+#include "../../include/dkm_projection.hpp"
+#include "../../include/dkm_serving.hpp"
+#include "../../include/dkm_window.hpp"
+#include "../datagen/datagen.hpp"
 #include "lest.hpp"
 
 #include <vector>
@@ -15,11 +35,24 @@ This is just simple test harness without any external dependencies.
 #include <cstdint>
 #include <algorithm>
 #include <tuple>
+#include <cstdio>
+#include <cmath>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
 
 #ifdef __clang__
 #pragma clang diagnostic ignored "-Wmissing-braces"
 #endif
 
+// the kmeans_lloyd under test: libdkm's in the library build of the tests, the header's otherwise
+#ifdef DKM_TEST_LIBRARY
+namespace tested = dkm::lib;
+#else
+namespace tested = dkm;
+#endif
+
 
 const lest::test specification[] = {
 	CASE("Small 2D dataset is successfully segmented into 3 clusters",) {
@@ -51,7 +84,7 @@ const lest::test specification[] = {
 			}
 			
 			SECTION("K-means calculated correctly via Lloyds method") {
-				auto means_clusters = dkm::kmeans_lloyd(data, 3);
+				auto means_clusters = tested::kmeans_lloyd(data, 3, 100);
 				auto means = std::get<0>(means_clusters);
 				auto clusters = std::get<1>(means_clusters);
 				// verify results
@@ -70,6 +103,277 @@ const lest::test specification[] = {
 		}
 	},
 
+#ifdef DKM_TEST_LIBRARY
+	CASE("libdkm selects an instruction set variant",) {
+		std::string isa = dkm::library_isa();
+		EXPECT((isa == "baseline" || isa == "avx2" || isa == "avx512"));
+		EXPECT(!dkm::select_library_isa("sse9"));
+		EXPECT(dkm::library_isa() == isa);
+	},
+
+	CASE("Every libdkm instruction set variant matches the header",) {
+		SETUP("Clustered points") {
+			datagen::spec s;
+			s.n = 2000;
+			s.clusters = 20;
+			s.seed = 5;
+			auto wide = datagen::generate<float, 128>(s);
+			auto narrow = datagen::generate<double, 3>(s);
+			auto wide_header = dkm::kmeans_lloyd(wide, 20, 20, 1);
+			auto narrow_header = dkm::kmeans_lloyd(narrow, 100, 20, 1);
+			std::string detected = dkm::library_isa();
+			for (const char* isa : {"baseline", "avx2", "avx512"}) {
+				if (!dkm::select_library_isa(isa)) {
+					continue;
+				}
+				auto w = dkm::lib::kmeans_lloyd(wide, 20, 20, 1);
+				EXPECT(std::get<0>(w) == std::get<0>(wide_header));
+				EXPECT(std::get<1>(w) == std::get<1>(wide_header));
+				auto n = dkm::lib::kmeans_lloyd(narrow, 100, 20, 1);
+				EXPECT(std::get<0>(n) == std::get<0>(narrow_header));
+				EXPECT(std::get<1>(n) == std::get<1>(narrow_header));
+			}
+			EXPECT(dkm::select_library_isa(detected.c_str()));
+		}
+	},
+
+#endif
+	CASE("Accelerated kmeans++ seeding picks the same means as recomputing every distance",) {
+		SETUP("Clustered points with duplicates") {
+			datagen::spec s;
+			s.kind = datagen::shape::duplicates;
+			s.n = 3000;
+			s.clusters = 12;
+			s.seed = 8;
+			auto points = datagen::generate<float, 4>(s);
+
+			SECTION("Means match a straightforward implementation") {
+				for (int seed : {1, 2, 3}) {
+					const uint32_t k = 40;
+					// the seeding as it was before the distances were updated incrementally
+					std::vector<std::array<float, 4>> expected;
+					std::linear_congruential_engine<uint64_t, 6364136223846793005, 1442695040888963407, UINT64_MAX>
+						engine(seed);
+					std::uniform_int_distribution<size_t> uniform(0, points.size() - 1);
+					expected.push_back(points[uniform(engine)]);
+					for (uint32_t count = 1; count < k; ++count) {
+						auto distances = dkm::details::closest_distance(expected, points, k);
+						std::discrete_distribution<size_t> generator(distances.begin(), distances.end());
+						auto index = generator(engine);
+						expected.push_back(points[index == distances.size() ? 0 : index]);
+					}
+					EXPECT(dkm::details::random_plusplus(points, k, seed) == expected);
+				}
+			}
+		}
+	},
+
+	CASE("Annulus, exponion and ball assignment reproduce kmeans_lloyd",) {
+		SETUP("Clustered points of 16 dimensions") {
+			datagen::spec s;
+			s.kind = datagen::shape::gaussian;
+			s.n = 4000;
+			s.clusters = 20;
+			s.seed = 4;
+			auto points = datagen::generate<float, 16>(s);
+			s.kind = datagen::shape::duplicates;
+			auto duplicates = datagen::generate<double, 16>(s);
+
+			SECTION("Means and labels match naive assignment") {
+				for (auto method : {dkm::assignment::annulus, dkm::assignment::exponion, dkm::assignment::ball}) {
+					auto expected = tested::kmeans_lloyd(points, 25, 100, 2);
+					auto actual = tested::kmeans_lloyd(points, 25, 100, 2, 0.0f, method);
+					EXPECT(std::get<1>(actual) == std::get<1>(expected));
+					EXPECT(std::get<0>(actual) == std::get<0>(expected));
+					auto expected_ties = tested::kmeans_lloyd(duplicates, 30, 100, 5);
+					auto actual_ties = tested::kmeans_lloyd(duplicates, 30, 100, 5, 0.0f, method);
+					EXPECT(std::get<1>(actual_ties) == std::get<1>(expected_ties));
+					EXPECT(std::get<0>(actual_ties) == std::get<0>(expected_ties));
+					auto single = tested::kmeans_lloyd(points, 1, 10, 3, 0.0f, method);
+					EXPECT(std::get<1>(single) == std::vector<uint32_t>(4000, 0));
+				}
+			}
+
+			SECTION("Ball assignment skips the balls in their stable area") {
+				datagen::spec w;
+				w.n = 4000;
+				w.clusters = 8;
+				w.separation = 40.0;
+				w.seed = 6;
+				auto separated = datagen::generate<float, 16>(w);
+				auto means = dkm::details::random_plusplus(separated, 8, 1);
+				dkm::details::ball_assignment<float, 16> balls(separated);
+				size_t skipped = 0;
+				for (int iteration = 0; iteration < 10; ++iteration) {
+					auto labels = balls.update(means);
+					EXPECT(labels == dkm::details::calculate_clusters(separated, means));
+					skipped += balls.skipped();
+					means = dkm::details::calculate_means(separated, labels, means, 8);
+				}
+				// once the means settle every ball lies in its stable area and no distance is computed
+				EXPECT(skipped > 0u);
+				EXPECT(balls.skipped() == separated.size());
+			}
+		}
+	},
+
+	CASE("Partial distance search finds the same closest mean",) {
+		SETUP("Points and means with 100 dimensions") {
+			std::mt19937 engine(7);
+			std::normal_distribution<double> normal(0.0, 1.0);
+			std::vector<std::array<double, 100>> means(16), points(500);
+			for (auto& m : means) {
+				for (auto& v : m) {
+					v = std::round(normal(engine));
+				}
+			}
+			// duplicate means make ties that must go to the lowest index
+			means[9] = means[3];
+			means[12] = means[3];
+			for (auto& p : points) {
+				for (auto& v : p) {
+					v = std::round(normal(engine));
+				}
+			}
+			points[0] = means[3];
+
+			SECTION("Bounded distances agree below the bound") {
+				for (auto& p : points) {
+					double full = dkm::details::distance_squared(p, means[0]);
+					EXPECT(dkm::details::distance_squared_bounded(p, means[0], full + 1.0) == full);
+					EXPECT(dkm::details::distance_squared_bounded(p, means[0], 1.0) >= 1.0);
+				}
+			}
+
+			SECTION("closest_mean matches an exhaustive search") {
+				for (auto& p : points) {
+					uint32_t expected = 0;
+					for (uint32_t j = 1; j < means.size(); ++j) {
+						if (dkm::details::distance_squared(p, means[j])
+							< dkm::details::distance_squared(p, means[expected])) {
+							expected = j;
+						}
+					}
+					EXPECT(dkm::details::closest_mean(p, means) == expected);
+				}
+				EXPECT(dkm::details::closest_mean(points[0], means) == 3u);
+			}
+		}
+	},
+
+	CASE("Test dkm::serving_model",) {
+		SETUP("Models whose means all hold their version") {
+			auto means_of = [](uint64_t version) {
+				std::vector<std::array<float, 2>> means;
+				for (int j = 0; j < 4; ++j) {
+					means.push_back({{static_cast<float>(version), static_cast<float>(version * 4 + j)}});
+				}
+				return means;
+			};
+			dkm::serving_model<float, 2> serving{dkm::model<float, 2>(means_of(0))};
+
+			SECTION("Publishing") {
+				EXPECT(serving.version() == 0u);
+				EXPECT(serving.predict(std::array<float, 2>{{0.f, 2.2f}}) == 2u);
+				serving.publish(means_of(1));
+				EXPECT(serving.version() == 1u);
+				EXPECT(serving.predict(std::array<float, 2>{{1.f, 6.9f}}) == 3u);
+				auto snapshot = serving.acquire();
+				EXPECT(snapshot->means() == means_of(1));
+			}
+
+			SECTION("Readers see whole models while a writer publishes") {
+				const uint64_t versions = 200;
+				std::vector<std::thread> readers;
+				std::vector<int> torn(4, 0), reads(4, 0);
+				for (size_t r = 0; r < 4; ++r) {
+					readers.emplace_back([&, r] {
+						uint64_t last = 0;
+						while (last < versions) {
+							auto snapshot = serving.acquire();
+							const uint64_t version = snapshot.version();
+							// versions never go back, and every mean belongs to the snapshot's version
+							torn[r] += version < last || snapshot->means() != means_of(version);
+							const std::array<float, 2> point{{0.f, static_cast<float>(version * 4) + 1.1f}};
+							torn[r] += snapshot->predict(point) != 1u;
+							last = version;
+							++reads[r];
+						}
+					});
+				}
+				for (uint64_t v = 1; v <= versions; ++v) {
+					serving.publish(means_of(v));
+				}
+				for (auto& reader : readers) {
+					reader.join();
+				}
+				for (size_t r = 0; r < 4; ++r) {
+					EXPECT(torn[r] == 0);
+					EXPECT(reads[r] > 0);
+				}
+			}
+		}
+	},
+
+	CASE("Test dkm::nearest_m and dkm::model",) {
+		SETUP() {
+			datagen::spec s;
+			s.n = 5000;
+			s.clusters = 6;
+			s.seed = 19;
+			auto points = datagen::generate<float, 5>(s);
+			auto clustering = tested::kmeans_lloyd(points, 12, 100, 2);
+			auto& means = std::get<0>(clustering);
+			dkm::model<float, 5> model(clustering);
+
+			SECTION("nearest_m matches sorting all distances") {
+				auto nearest = dkm::nearest_m(points, means, 3, 4);
+				EXPECT(nearest.m == 3u);
+				for (size_t i = 0; i < points.size(); i += 37) {
+					std::vector<std::pair<float, uint32_t>> all;
+					for (uint32_t j = 0; j < means.size(); ++j) {
+						all.push_back({dkm::details::distance_squared(points[i], means[j]), j});
+					}
+					std::sort(all.begin(), all.end());
+					for (size_t r = 0; r < 3; ++r) {
+						EXPECT(nearest.indices[i * 3 + r] == all[r].second);
+						EXPECT(nearest.distances[i * 3 + r] == all[r].first);
+					}
+				}
+				EXPECT(dkm::nearest_m(points, means, 50).m == 12u);
+			}
+
+			SECTION("predict gives the labels of kmeans_lloyd") {
+				// the labels were computed before the last update of the means, so label with the means once more
+				auto labels = dkm::details::calculate_clusters(points, means);
+				EXPECT(model.predict(points, 1) == labels);
+				EXPECT(model.predict(points, 8) == labels);
+				EXPECT(model.predict(points[7]) == labels[7]);
+			}
+
+			SECTION("Margins separate clear from ambiguous points") {
+				auto predictions = model.predict_with_margin(points, 3);
+				auto labels = model.predict(points);
+				for (size_t i = 0; i < points.size(); ++i) {
+					EXPECT(predictions[i].label == labels[i]);
+					EXPECT(predictions[i].runner_up != labels[i]);
+					EXPECT(predictions[i].margin >= 0.0f);
+				}
+				// a point halfway between two means
+				std::array<float, 5> middle;
+				for (size_t d = 0; d < 5; ++d) {
+					middle[d] = 0.5f * (means[0][d] + means[1][d]);
+				}
+				dkm::model<float, 5> pair(std::vector<std::array<float, 5>>{means[0], means[1]});
+				EXPECT(pair.predict_with_margin(middle).margin < 1e-3f);
+				EXPECT(model.predict_with_margin(means[4]).distance == 0.0f);
+				EXPECT(model.predict_with_margin(means[4]).label == 4u);
+				dkm::model<float, 5> single(std::vector<std::array<float, 5>>{means[0]});
+				EXPECT(single.predict_with_margin(middle).margin == 0.0f);
+			}
+		}
+	},
+
 	CASE("Test dkm::get_cluster",) {
 		SETUP() {
 			std::vector<std::array<double, 2>> points{
@@ -265,7 +569,7 @@ const lest::test specification[] = {
 						{1000, 1000}
 				};
 				uint32_t k = 2;
-				auto means = dkm::kmeans_lloyd(data, k);
+				auto means = tested::kmeans_lloyd(data, k, 100);
 				double inertia = dkm::means_inertia(data, means, k);
 				EXPECT(284.256926 == lest::approx(inertia).epsilon(1e-6));
 			}
@@ -306,7 +610,959 @@ const lest::test specification[] = {
 				}
 			}
 		}
-	}
+	},
+	CASE("Test datagen reproducibility",) {
+		SETUP() {
+			datagen::spec s;
+			s.n = 3 * datagen::block_size + 17;
+			s.clusters = 5;
+			s.seed = 7;
+
+			SECTION("Output does not depend on the number of threads") {
+				for (auto kind : {datagen::shape::gaussian, datagen::shape::anisotropic, datagen::shape::imbalanced,
+						 datagen::shape::heavy_tailed, datagen::shape::duplicates, datagen::shape::low_rank}) {
+					s.kind = kind;
+					s.threads = 1;
+					auto single = datagen::generate<float, 3>(s);
+					s.threads = 4;
+					auto multi = datagen::generate<float, 3>(s);
+					EXPECT(single == multi);
+				}
+			}
+
+			SECTION("Any range of points can be regenerated on its own") {
+				auto all = datagen::generate<double, 3>(s);
+				s.dims = 3;
+				datagen::generator gen(s);
+				std::vector<std::array<double, 3>> part(100);
+				uint64_t first = datagen::block_size - 50;
+				gen.generate(first, part.size(), part[0].data());
+				EXPECT(std::equal(part.begin(), part.end(), all.begin() + first));
+			}
+
+			SECTION("Binary files hold the in-memory data set") {
+				s.kind = datagen::shape::duplicates;
+				s.dims = 4;
+				std::string path = "datagen_test.bin";
+				datagen::write_file<float>(s, path);
+				auto loaded = datagen::read_file<float, 4>(path);
+				EXPECT((loaded == datagen::generate<float, 4>(s)));
+				EXPECT_THROWS((datagen::read_file<double, 4>(path)));
+				std::remove(path.c_str());
+			}
+		}
+	},
+	CASE("Test dkm::kmeans_1d",) {
+		SETUP() {
+			std::mt19937 engine(21);
+			std::normal_distribution<double> normal(0.0, 1.0);
+			auto sse = [](const std::vector<std::array<double, 1>>& data,
+						   const std::tuple<std::vector<std::array<double, 1>>, std::vector<uint32_t>>& result) {
+				double total = 0.0;
+				for (size_t i = 0; i < data.size(); ++i) {
+					total += dkm::details::distance_squared(data[i], std::get<0>(result)[std::get<1>(result)[i]]);
+				}
+				return total;
+			};
+
+			SECTION("Finds the optimum of every split of the sorted values") {
+				for (int trial = 0; trial < 20; ++trial) {
+					std::vector<std::array<double, 1>> data(16);
+					for (auto& p : data) {
+						p[0] = std::round(normal(engine) * 4.0) + (trial % 2 ? 100.0 * (normal(engine) > 0) : 0.0);
+					}
+					std::vector<double> sorted;
+					for (auto& p : data) {
+						sorted.push_back(p[0]);
+					}
+					std::sort(sorted.begin(), sorted.end());
+					auto range_sse = [&sorted](size_t first, size_t last) {
+						double mean = 0.0;
+						for (size_t i = first; i < last; ++i) {
+							mean += sorted[i];
+						}
+						mean /= static_cast<double>(last - first);
+						double total = 0.0;
+						for (size_t i = first; i < last; ++i) {
+							total += (sorted[i] - mean) * (sorted[i] - mean);
+						}
+						return total;
+					};
+					double best = std::numeric_limits<double>::max();
+					for (size_t a = 1; a < data.size(); ++a) {
+						for (size_t b = a + 1; b < data.size(); ++b) {
+							best = std::min(best, range_sse(0, a) + range_sse(a, b) + range_sse(b, data.size()));
+						}
+					}
+					auto result = dkm::kmeans_1d(data, 3);
+					EXPECT(sse(data, result) == lest::approx(best));
+					auto& means = std::get<0>(result);
+					EXPECT(std::is_sorted(means.begin(), means.end()));
+					for (size_t i = 0; i < data.size(); ++i) {
+						EXPECT(std::get<1>(result)[i] == dkm::details::closest_mean(data[i], means));
+					}
+				}
+			}
+
+			SECTION("Is never worse than Lloyd's algorithm") {
+				datagen::spec s;
+				s.n = 3000;
+				s.clusters = 7;
+				s.seed = 6;
+				auto data = datagen::generate<double, 1>(s);
+				double optimum = sse(data, dkm::kmeans_1d(data, 7));
+				for (int seed = 1; seed <= 5; ++seed) {
+					EXPECT(optimum <= sse(data, tested::kmeans_lloyd(data, 7, 100, seed)) + 1e-9);
+				}
+			}
+
+			SECTION("One cluster per point") {
+				std::vector<std::array<double, 1>> data{{3.0}, {1.0}, {2.0}};
+				auto result = dkm::kmeans_1d(data, 3);
+				EXPECT(std::get<1>(result) == (std::vector<uint32_t>{2, 0, 1}));
+				EXPECT(std::get<0>(result)[0][0] == 1.0);
+				EXPECT(std::get<0>(result)[2][0] == 3.0);
+			}
+		}
+	},
+
+	CASE("Test dkm::kmeans_grid",) {
+		SETUP() {
+			datagen::spec s;
+			s.n = 20000;
+			s.clusters = 9;
+			s.seed = 14;
+			auto points = datagen::generate<double, 2>(s);
+			s.kind = datagen::shape::duplicates;
+			auto duplicates = datagen::generate<double, 3>(s);
+
+			SECTION("Matches kmeans_lloyd") {
+				auto expected = tested::kmeans_lloyd(points, 9, 100, 3);
+				auto actual = dkm::kmeans_grid(points, 9, 100, 3);
+				EXPECT(std::get<1>(actual) == std::get<1>(expected));
+				for (size_t j = 0; j < 9; ++j) {
+					for (size_t d = 0; d < 2; ++d) {
+						EXPECT(std::get<0>(actual)[j][d] == lest::approx(std::get<0>(expected)[j][d]));
+					}
+				}
+				auto expected_ties = tested::kmeans_lloyd(duplicates, 12, 100, 4);
+				auto actual_ties = dkm::kmeans_grid(duplicates, 12, 100, 4, 0.0f, 8);
+				EXPECT(std::get<1>(actual_ties) == std::get<1>(expected_ties));
+			}
+
+			SECTION("A single cell holds all points") {
+				auto actual = dkm::kmeans_grid(points, 9, 100, 3, 0.0f, points.size());
+				EXPECT(std::get<1>(actual) == std::get<1>(tested::kmeans_lloyd(points, 9, 100, 3)));
+			}
+		}
+	},
+
+	CASE("Test dkm::kmeans_histogram",) {
+		SETUP("An image of noisy colours around a few centres") {
+			std::mt19937 engine(17);
+			std::normal_distribution<double> normal(0.0, 6.0);
+			std::uniform_int_distribution<int> centre(0, 4);
+			const std::array<std::array<double, 3>, 5> centres{
+				{{{30, 30, 30}}, {{220, 40, 40}}, {{40, 200, 60}}, {{50, 60, 230}}, {{240, 240, 200}}}};
+			std::vector<std::array<uint8_t, 3>> image(200000);
+			for (auto& pixel : image) {
+				auto& c = centres[centre(engine)];
+				for (size_t d = 0; d < 3; ++d) {
+					pixel[d] = static_cast<uint8_t>(std::min(255.0, std::max(0.0, std::round(c[d] + normal(engine)))));
+				}
+			}
+
+			SECTION("Every pixel is labelled with its closest mean") {
+				dkm::histogram_kmeans<3> clustering(image, 5, 100, 2, 4);
+				auto& means = clustering.means();
+				EXPECT(means.size() == 5u);
+				auto labels = clustering.labels(image);
+				for (size_t i = 0; i < image.size(); i += 97) {
+					std::array<float, 3> p{{float(image[i][0]), float(image[i][1]), float(image[i][2])}};
+					EXPECT(labels[i] == dkm::details::closest_mean(p, means));
+				}
+				// a colour that isn't in the image
+				std::array<uint8_t, 3> unseen{{128, 0, 255}};
+				std::array<float, 3> p{{128.0f, 0.0f, 255.0f}};
+				EXPECT(clustering.label(unseen) == dkm::details::closest_mean(p, means));
+				// the means are close to the centres the colours were drawn around
+				for (auto& c : centres) {
+					double closest = std::numeric_limits<double>::max();
+					for (auto& m : means) {
+						double d = 0.0;
+						for (size_t j = 0; j < 3; ++j) {
+							d += (m[j] - c[j]) * (m[j] - c[j]);
+						}
+						closest = std::min(closest, d);
+					}
+					EXPECT(closest < 4.0);
+				}
+			}
+
+			SECTION("Table lookups match the closest mean when the iterations run out") {
+				// uniform colours, whose means still move a lot after the single iteration allowed
+				std::uniform_int_distribution<int> channel(0, 255);
+				std::vector<std::array<uint8_t, 3>> noise(50000);
+				for (auto& pixel : noise) {
+					for (auto& c : pixel) {
+						c = static_cast<uint8_t>(channel(engine));
+					}
+				}
+				dkm::histogram_kmeans<3> clustering(noise, 8, 1, 2, 1);
+				auto labels = clustering.labels(noise);
+				size_t mismatches = 0;
+				for (size_t i = 0; i < noise.size(); ++i) {
+					std::array<float, 3> p{{float(noise[i][0]), float(noise[i][1]), float(noise[i][2])}};
+					mismatches += labels[i] != dkm::details::closest_mean(p, clustering.means());
+				}
+				EXPECT(mismatches == 0u);
+			}
+
+			SECTION("Results don't depend on the number of threads") {
+				auto one = dkm::kmeans_histogram(image, 5, 100, 3, 1);
+				auto many = dkm::kmeans_histogram(image, 5, 100, 3, 8);
+				EXPECT(std::get<0>(one) == std::get<0>(many));
+				EXPECT(std::get<1>(one) == std::get<1>(many));
+			}
+
+			SECTION("Fewer distinct values than clusters") {
+				std::vector<std::array<uint8_t, 3>> flat(1000, std::array<uint8_t, 3>{{1, 2, 3}});
+				flat[10] = {{9, 9, 9}};
+				auto result = dkm::kmeans_histogram(flat, 4, 100, 1);
+				EXPECT(std::get<0>(result).size() == 2u);
+				EXPECT(std::get<1>(result)[10] == 1u);
+				EXPECT(std::get<1>(result)[0] == 0u);
+			}
+		}
+	},
+
+	CASE("Test dkm::sliding_window_kmeans",) {
+		SETUP() {
+			datagen::spec s;
+			s.n = 5000;
+			s.clusters = 4;
+			s.seed = 3;
+			auto stream = datagen::generate<double, 3>(s);
+			const size_t window = 1000, hop = 64;
+			dkm::sliding_window_kmeans<double, 3> clusterer(4, window, 100, 1);
+
+			SECTION("Means are empty until the window holds k frames") {
+				clusterer.push({stream[0], stream[1], stream[2]});
+				EXPECT(clusterer.means().empty());
+				EXPECT(clusterer.size() == 3u);
+			}
+
+			SECTION("Every hop converges to a Lloyd fixed point of the current window") {
+				for (size_t first = 0; first < stream.size(); first += hop) {
+					size_t last = std::min(first + hop, stream.size());
+					clusterer.push(std::vector<std::array<double, 3>>(stream.begin() + first, stream.begin() + last));
+					EXPECT(clusterer.size() == std::min(last, window));
+				}
+				std::vector<std::array<double, 3>> contents(stream.end() - window, stream.end());
+				auto labels = clusterer.labels();
+				auto& means = clusterer.means();
+				EXPECT(means.size() == 4u);
+				// every frame is labelled with its closest mean ...
+				for (size_t i = 0; i < contents.size(); ++i) {
+					EXPECT(labels[i] == dkm::details::closest_mean(contents[i], means));
+				}
+				// ... and every mean is the average of its frames
+				auto expected = dkm::details::calculate_means(contents, labels, means, 4);
+				for (size_t j = 0; j < means.size(); ++j) {
+					for (size_t d = 0; d < 3; ++d) {
+						EXPECT(means[j][d] == lest::approx(expected[j][d]));
+					}
+				}
+			}
+
+			SECTION("A hop only visits the new frames and the frames near a boundary") {
+				size_t visited = 0, hops = 0;
+				for (size_t first = 0; first < stream.size(); first += hop) {
+					size_t last = std::min(first + hop, stream.size());
+					clusterer.push(std::vector<std::array<double, 3>>(stream.begin() + first, stream.begin() + last));
+					if (first >= 2 * window) {
+						visited += clusterer.visited();
+						++hops;
+					}
+				}
+				// a sweep over the window per iteration would visit at least `window` frames per hop
+				EXPECT(visited < hops * window / 4);
+			}
+		}
+	},
+	CASE("Test dkm::dynamic_kmeans",) {
+		SETUP() {
+			datagen::spec s;
+			s.n = 3000;
+			s.clusters = 6;
+			s.seed = 9;
+			auto points = datagen::generate<double, 3>(s);
+			dkm::dynamic_kmeans<double, 3> clusterer(6, 100, 2, 1);
+
+			SECTION("Every edit leaves the points labelled with their closest mean") {
+				// overlapping clusters, where moving means pull in points of their neighbours, and enough passes to
+				// converge, so that local refinement has to match a full assignment every time
+				datagen::spec o = s;
+				o.separation = 1.5;
+				auto overlapping = datagen::generate<double, 3>(o);
+				dkm::dynamic_kmeans<double, 3> exact(10, 100, 1000, 2);
+				std::vector<size_t> ids;
+				for (size_t first = 0; first < 3000; first += 100) {
+					auto batch = exact.insert(std::vector<std::array<double, 3>>(
+						overlapping.begin() + first, overlapping.begin() + first + 100));
+					ids.insert(ids.end(), batch.begin(), batch.end());
+					if (first % 500 == 400) {
+						exact.erase(std::vector<size_t>(ids.end() - 150, ids.end() - 50));
+						ids.erase(ids.end() - 150, ids.end() - 50);
+					}
+					std::vector<std::array<double, 3>> contents;
+					std::vector<uint32_t> labels;
+					for (auto id : ids) {
+						contents.push_back(exact.point(id));
+						labels.push_back(exact.label(id));
+					}
+					EXPECT(labels == dkm::details::calculate_clusters(contents, exact.means()));
+				}
+			}
+
+			SECTION("Means are empty until the data set holds k points") {
+				auto ids = clusterer.insert({points[0], points[1], points[2]});
+				EXPECT(clusterer.means().empty());
+				EXPECT(clusterer.size() == 3u);
+				EXPECT(ids == (std::vector<size_t>{0, 1, 2}));
+			}
+
+			SECTION("Means and labels follow insertions and deletions") {
+				std::vector<size_t> ids;
+				for (size_t first = 0; first < 2000; first += 250) {
+					auto batch = clusterer.insert(
+						std::vector<std::array<double, 3>>(points.begin() + first, points.begin() + first + 250));
+					ids.insert(ids.end(), batch.begin(), batch.end());
+				}
+				// erase every third point, then fill the freed ids again
+				std::vector<size_t> erased;
+				for (size_t i = 0; i < ids.size(); i += 3) {
+					erased.push_back(ids[i]);
+				}
+				clusterer.erase(erased);
+				EXPECT(clusterer.size() == 2000u - erased.size());
+				EXPECT(!clusterer.contains(erased.front()));
+				auto reused = clusterer.insert(std::vector<std::array<double, 3>>(points.begin() + 2000, points.end()));
+				EXPECT(clusterer.size() == 3000u - erased.size());
+				EXPECT(reused.size() == 1000u);
+				EXPECT(clusterer.contains(erased.front()));
+
+				std::vector<std::array<double, 3>> contents;
+				std::vector<uint32_t> labels;
+				for (size_t id = 0; id < 3000; ++id) {
+					if (clusterer.contains(id)) {
+						contents.push_back(clusterer.point(id));
+						labels.push_back(clusterer.label(id));
+					}
+				}
+				EXPECT(contents.size() == clusterer.size());
+				// every mean is the average of its points ...
+				auto& means = clusterer.means();
+				auto expected = dkm::details::calculate_means(contents, labels, means, 6);
+				for (size_t j = 0; j < means.size(); ++j) {
+					for (size_t d = 0; d < 3; ++d) {
+						EXPECT(means[j][d] == lest::approx(expected[j][d]));
+					}
+				}
+				// ... and local passes alone reach a Lloyd fixed point
+				clusterer.refine(1000);
+				labels.clear();
+				for (size_t id = 0; id < 3000; ++id) {
+					if (clusterer.contains(id)) {
+						labels.push_back(clusterer.label(id));
+					}
+				}
+				EXPECT(labels == dkm::details::calculate_clusters(contents, means));
+				for (int pass = 0; pass < 100; ++pass) {
+					clusterer.refine_all();
+				}
+				for (size_t id = 0; id < 3000; ++id) {
+					if (clusterer.contains(id)) {
+						EXPECT(clusterer.label(id) == dkm::details::closest_mean(clusterer.point(id), means));
+					}
+				}
+			}
+		}
+	},
+
+	CASE("Test dkm::kmeans_majority",) {
+		SETUP("Noisy copies of a few 256-bit fingerprints") {
+			std::mt19937_64 engine(23);
+			std::vector<std::array<uint64_t, 4>> prototypes(5);
+			for (auto& p : prototypes) {
+				for (auto& w : p) {
+					w = engine();
+				}
+			}
+			std::bernoulli_distribution flip(0.08);
+			std::vector<std::array<uint64_t, 4>> data;
+			std::vector<uint32_t> sources;
+			for (size_t i = 0; i < 1000; ++i) {
+				auto point = prototypes[i % 5];
+				for (auto& w : point) {
+					for (size_t b = 0; b < 64; ++b) {
+						if (flip(engine)) {
+							w ^= uint64_t(1) << b;
+						}
+					}
+				}
+				data.push_back(point);
+				sources.push_back(static_cast<uint32_t>(i % 5));
+			}
+
+			SECTION("Hamming distance and packing") {
+				std::array<uint8_t, 12> bytes{{0xff, 0, 0, 0, 0, 0, 0, 0x80, 3}};
+				auto packed = dkm::pack_bits<2>(bytes);
+				EXPECT(packed[0] == 0x80000000000000ffull);
+				EXPECT(packed[1] == 3u);
+				EXPECT(dkm::details::hamming_distance(packed, std::array<uint64_t, 2>{}) == 11u);
+				EXPECT(dkm::details::popcount(~uint64_t(0)) == 64u);
+			}
+
+#ifdef DKM_POPCOUNT_DISPATCH
+			SECTION("The POPCNT assignment step labels like the portable one") {
+				if (dkm::details::cpu_has_popcnt()) {
+					std::vector<std::array<uint64_t, 4>> centroids(prototypes.begin(), prototypes.begin() + 3);
+					centroids.push_back(data[7]);
+					std::vector<uint32_t> portable(data.size()), hardware(data.size());
+					EXPECT(dkm::details::assign_centroids(data, centroids, portable));
+					EXPECT(dkm::details::assign_centroids_popcnt(data, centroids, hardware));
+					EXPECT(hardware == portable);
+					EXPECT_NOT(dkm::details::assign_centroids_popcnt(data, centroids, hardware));
+				}
+			}
+#endif
+
+			SECTION("Finds the prototypes") {
+				auto result = dkm::kmeans_majority(data, 5, 100, 2);
+				auto& centroids = std::get<0>(result);
+				auto& labels = std::get<1>(result);
+				// every cluster holds the copies of one prototype, whose bits the majority vote restores
+				for (size_t i = 0; i < data.size(); ++i) {
+					EXPECT(labels[i] == labels[sources[i]]);
+				}
+				for (uint32_t s = 0; s < 5; ++s) {
+					EXPECT(centroids[labels[s]] == prototypes[s]);
+				}
+			}
+
+			SECTION("Fewer distinct descriptors than clusters") {
+				std::vector<std::array<uint64_t, 4>> same(10, prototypes[0]);
+				auto result = dkm::kmeans_majority(same, 3, 10, 2);
+				EXPECT(std::get<0>(result).size() == 3u);
+				EXPECT(std::get<1>(result) == std::vector<uint32_t>(10, 0));
+			}
+		}
+	},
+
+	CASE("Test dkm::kmeans_kernel",) {
+		SETUP("Two concentric rings") {
+			std::mt19937 engine(1);
+			std::normal_distribution<double> noise(0.0, 0.05);
+			std::uniform_real_distribution<double> angle(0.0, 6.2831853);
+			std::vector<std::array<double, 2>> rings;
+			for (int i = 0; i < 400; ++i) {
+				double radius = i % 2 ? 1.0 : 4.0;
+				double a = angle(engine);
+				rings.push_back({radius * std::cos(a) + noise(engine), radius * std::sin(a) + noise(engine)});
+			}
+
+			SECTION("The Nystroem embedding reproduces the kernel between landmarks") {
+				std::vector<std::array<double, 2>> landmarks(rings.begin(), rings.begin() + 16);
+				dkm::rbf_kernel kernel(1.0);
+				dkm::nystroem_embedding<double, 2, 16, dkm::rbf_kernel> embedding(landmarks, kernel);
+				for (auto& a : landmarks) {
+					for (auto& b : landmarks) {
+						auto ea = embedding(a), eb = embedding(b);
+						double dot = 0.0;
+						for (size_t i = 0; i < ea.size(); ++i) {
+							dot += ea[i] * eb[i];
+						}
+						EXPECT(dot == lest::approx(kernel(a, b)));
+					}
+				}
+			}
+
+			SECTION("RBF kernel k-means separates the rings") {
+				auto result = dkm::kmeans_kernel<32>(rings, 2, dkm::rbf_kernel(0.5), 100, 3);
+				auto& labels = std::get<1>(result);
+				EXPECT(std::get<0>(result).size() == 2u);
+				EXPECT(labels.size() == rings.size());
+				for (size_t i = 2; i < labels.size(); ++i) {
+					EXPECT(labels[i] == labels[i % 2]);
+				}
+				EXPECT(labels[0] != labels[1]);
+			}
+		}
+	},
+	CASE("Test dkm::fuzzy_cmeans",) {
+		SETUP("Three well separated clusters") {
+			std::vector<std::array<double, 2>> points{
+				{-1, 0}, {1, 0}, {0, -1}, {0, 1},
+				{99, 0}, {101, 0}, {100, -1}, {100, 1},
+				{-1, 100}, {1, 100}, {0, 99}, {0, 101}
+			};
+			std::vector<std::array<double, 2>> centres{{0, 0}, {100, 0}, {0, 100}};
+
+			SECTION("Centroids are found for m = 2 and other fuzzifiers") {
+				for (double m : {2.0, 1.5, 3.0}) {
+					auto centroids = dkm::fuzzy_cmeans(points, 3, m, 100, 1);
+					std::sort(centroids.begin(), centroids.end());
+					std::sort(centres.begin(), centres.end());
+					for (size_t j = 0; j < centres.size(); ++j) {
+						EXPECT(centroids[j][0] == lest::approx(centres[j][0]).epsilon(0.01).scale(100.0));
+						EXPECT(centroids[j][1] == lest::approx(centres[j][1]).epsilon(0.01).scale(100.0));
+					}
+				}
+			}
+
+			SECTION("Memberships sum to one and are hard on a centroid") {
+				auto memberships = dkm::fuzzy_memberships(points, centres, 2.0);
+				EXPECT(memberships.size() == points.size() * 3);
+				for (size_t i = 0; i < points.size(); ++i) {
+					double total = memberships[i * 3] + memberships[i * 3 + 1] + memberships[i * 3 + 2];
+					EXPECT(total == lest::approx(1.0));
+					EXPECT(memberships[i * 3 + i / 4] > 0.99);
+				}
+				auto on_centroid = dkm::fuzzy_memberships(centres, centres, 2.0);
+				EXPECT(on_centroid == (std::vector<double>{1, 0, 0, 0, 1, 0, 0, 0, 1}));
+			}
+
+			SECTION("Memberships stay finite for m close to 1 and large coordinates") {
+				auto far = points;
+				auto far_centres = centres;
+				for (auto* set : {&far, &far_centres}) {
+					for (auto& p : *set) {
+						p[0] = 100.0 * p[0] + 1000.0;
+						p[1] = 100.0 * p[1] + 1000.0;
+					}
+				}
+				// off the centroids, every squared distance is above 2500, whose power -1 / (m - 1) = -100 underflows
+				std::vector<std::array<double, 2>> off(far.size());
+				std::transform(far.begin(), far.end(), off.begin(), [](std::array<double, 2> p) {
+					return std::array<double, 2>{{p[0] + 50.0, p[1] + 50.0}};
+				});
+				auto memberships = dkm::fuzzy_memberships(off, far_centres, 1.01);
+				for (size_t i = 0; i < off.size(); ++i) {
+					double total = memberships[i * 3] + memberships[i * 3 + 1] + memberships[i * 3 + 2];
+					EXPECT(total == lest::approx(1.0));
+					EXPECT(memberships[i * 3 + i / 4] > 0.99);
+				}
+				auto centroids = dkm::fuzzy_cmeans(far, 3, 1.01, 100, 1);
+				std::sort(centroids.begin(), centroids.end());
+				std::sort(far_centres.begin(), far_centres.end());
+				for (size_t j = 0; j < far_centres.size(); ++j) {
+					EXPECT(centroids[j][0] == lest::approx(far_centres[j][0]).epsilon(0.01).scale(10000.0));
+					EXPECT(centroids[j][1] == lest::approx(far_centres[j][1]).epsilon(0.01).scale(10000.0));
+				}
+			}
+		}
+	},
+	CASE("Test dkm::fit_gmm_diag",) {
+		SETUP("Mixture of two diagonal Gaussians") {
+			std::mt19937 engine(5);
+			std::normal_distribution<double> normal(0.0, 1.0);
+			std::uniform_real_distribution<double> uniform(0.0, 1.0);
+			std::vector<std::array<double, 2>> points;
+			for (int i = 0; i < 20000; ++i) {
+				if (uniform(engine) < 0.3) {
+					points.push_back({-5.0 + 0.5 * normal(engine), 2.0 * normal(engine)});
+				} else {
+					points.push_back({5.0 + 2.0 * normal(engine), 1.0 + 0.25 * normal(engine)});
+				}
+			}
+			auto clustering = tested::kmeans_lloyd(points, 2, 100, 1);
+
+			SECTION("Weights, means and variances are recovered") {
+				auto model = dkm::fit_gmm_diag(points, clustering, 200, 1e-9, 1e-6, 2);
+				size_t left = model.means[0][0] < model.means[1][0] ? 0 : 1;
+				size_t right = 1 - left;
+				EXPECT(model.iterations > 0);
+				EXPECT(model.weights[left] == lest::approx(0.3).epsilon(0.05));
+				EXPECT(model.weights[right] == lest::approx(0.7).epsilon(0.05));
+				EXPECT(model.means[left][0] == lest::approx(-5.0).epsilon(0.05));
+				EXPECT(model.means[right][1] == lest::approx(1.0).epsilon(0.05));
+				EXPECT(model.variances[left][0] == lest::approx(0.25).epsilon(0.1));
+				EXPECT(model.variances[left][1] == lest::approx(4.0).epsilon(0.1));
+				EXPECT(model.variances[right][0] == lest::approx(4.0).epsilon(0.1));
+				EXPECT(model.variances[right][1] == lest::approx(0.0625).epsilon(0.1));
+			}
+
+			SECTION("The fit does not depend on the number of threads") {
+				auto single = dkm::fit_gmm_diag(points, clustering, 50, 1e-9, 1e-6, 1);
+				auto multi = dkm::fit_gmm_diag(points, clustering, 50, 1e-9, 1e-6, 3);
+				EXPECT(single.log_likelihood == lest::approx(multi.log_likelihood));
+				for (size_t j = 0; j < 2; ++j) {
+					EXPECT(single.weights[j] == lest::approx(multi.weights[j]));
+					EXPECT(single.means[j][0] == lest::approx(multi.means[j][0]));
+					EXPECT(single.variances[j][1] == lest::approx(multi.variances[j][1]));
+				}
+			}
+		}
+	},
+	CASE("Test dkm::kmeans_balanced",) {
+		SETUP("Imbalanced clusters") {
+			datagen::spec s;
+			s.kind = datagen::shape::imbalanced;
+			s.n = 1000;
+			s.clusters = 4;
+			s.seed = 11;
+			auto points = datagen::generate<double, 2>(s);
+			auto sizes = [](const std::vector<uint32_t>& labels, uint32_t k) {
+				std::vector<size_t> counts(k, 0);
+				for (auto l : labels) {
+					++counts[l];
+				}
+				return counts;
+			};
+
+			SECTION("Equal sizes are enforced exactly") {
+				auto result = dkm::kmeans_balanced(points, 4, 250, 250, 20, 1);
+				for (auto count : sizes(std::get<1>(result), 4)) {
+					EXPECT(count == 250u);
+				}
+			}
+
+			SECTION("Minimum and maximum sizes are respected") {
+				auto result = dkm::kmeans_balanced(points, 4, 150, 400, 20, 1, 0.0f, 2);
+				for (auto count : sizes(std::get<1>(result), 4)) {
+					EXPECT(count >= 150u);
+					EXPECT(count <= 400u);
+				}
+			}
+
+			SECTION("Without binding constraints every point goes to its closest mean") {
+				auto result = dkm::kmeans_balanced(points, 4, 0, points.size(), 20, 1);
+				auto& means = std::get<0>(result);
+				auto& labels = std::get<1>(result);
+				auto expected = dkm::details::calculate_clusters(points, means);
+				EXPECT(labels.size() == points.size());
+				size_t mismatches = 0;
+				for (size_t i = 0; i < points.size(); ++i) {
+					mismatches += labels[i] != expected[i];
+				}
+				EXPECT(mismatches == 0u);
+			}
+
+			SECTION("The size-constrained assignment matches an exhaustive search") {
+				// every assignment of 8 points to 3 means with 2 to 3 points each, on 20 sets of points
+				const size_t n = 8, min_size = 2, max_size = 3;
+				const uint32_t k = 3;
+				size_t worse = 0, unbalanced = 0;
+				for (size_t set = 0; set < 20; ++set) {
+					std::vector<std::array<double, 2>> subset(points.begin() + set * 40, points.begin() + set * 40 + n);
+					std::vector<std::array<double, 2>> means{points[set], points[set + 500], points[set + 900]};
+					std::vector<double> prices(k);
+					uint32_t candidates = k;
+					auto cost = [&](const std::vector<uint32_t>& labels) {
+						double total = 0.0;
+						for (size_t i = 0; i < n; ++i) {
+							total += dkm::details::distance_squared(subset[i], means[labels[i]]);
+						}
+						return total;
+					};
+					auto labels =
+						dkm::details::capacitated_assignment(subset, means, min_size, max_size, candidates, {}, prices);
+					for (auto count : sizes(labels, k)) {
+						unbalanced += count < min_size || count > max_size;
+					}
+					double best = std::numeric_limits<double>::infinity();
+					std::vector<uint32_t> trial(n);
+					for (size_t code = 0; code < 6561; ++code) {
+						for (size_t i = 0, rest = code; i < n; ++i, rest /= k) {
+							trial[i] = static_cast<uint32_t>(rest % k);
+						}
+						bool valid = true;
+						for (auto count : sizes(trial, k)) {
+							valid = valid && count >= min_size && count <= max_size;
+						}
+						if (valid) {
+							best = std::min(best, cost(trial));
+						}
+					}
+					worse += cost(labels) > best * (1.0 + 1e-9);
+				}
+				EXPECT(unbalanced == 0u);
+				EXPECT(worse == 0u);
+			}
+
+			SECTION("The candidate search finds the same closest means as sorting all distances") {
+				auto means = std::get<0>(tested::kmeans_lloyd(points, 40, 5, 1));
+				means.push_back(means[3]); // a tie, which must keep the lowest index first
+				auto neighbours = dkm::details::mean_neighbours(means);
+				const uint32_t c = 3;
+				std::vector<std::pair<double, uint32_t>> all(means.size()), found(c);
+				size_t mismatches = 0;
+				for (size_t i = 0; i < points.size(); ++i) {
+					for (uint32_t j = 0; j < means.size(); ++j) {
+						all[j] = {dkm::details::distance_squared(points[i], means[j]), j};
+					}
+					std::partial_sort(all.begin(), all.begin() + c, all.end());
+					// search from a far mean as well as from a near one
+					dkm::details::nearest_means(points[i], means, neighbours, static_cast<uint32_t>(i % 41), c,
+						found.data());
+					mismatches += !std::equal(found.begin(), found.end(), all.begin());
+				}
+				EXPECT(mismatches == 0u);
+			}
+		}
+	},
+	CASE("Test dkm::kmeans_balanced on many points",) {
+		SETUP("20 blobs of unequal sizes") {
+			datagen::spec s;
+			s.kind = datagen::shape::imbalanced;
+			s.n = 100000;
+			s.clusters = 20;
+			s.seed = 5;
+			auto points = datagen::generate<float, 2>(s);
+
+			SECTION("Equal sizes are enforced with few candidates") {
+				auto result = dkm::kmeans_balanced(points, 20, 5000, 5000, 5, 1, 0.0f, 4);
+				std::vector<size_t> counts(20, 0);
+				for (auto l : std::get<1>(result)) {
+					++counts[l];
+				}
+				EXPECT(std::all_of(counts.begin(), counts.end(), [](size_t count) { return count == 5000u; }));
+			}
+
+			SECTION("Prices carried over from the last assignment leave little to move") {
+				auto means = std::get<0>(dkm::kmeans_balanced(points, 20, 4000, 6000, 5, 1));
+				std::vector<double> prices(20);
+				uint32_t candidates = 4;
+				auto first = dkm::details::capacitated_assignment(points, means, 4000, 6000, candidates, {}, prices);
+				// the same means again: every point starts where the first call left it
+				auto second =
+					dkm::details::capacitated_assignment(points, means, 4000, 6000, candidates, first, prices);
+				size_t moved = 0;
+				for (size_t i = 0; i < points.size(); ++i) {
+					moved += first[i] != second[i];
+				}
+				EXPECT(moved < 10u);
+			}
+		}
+	},
+	CASE("Test dkm::kmeans_lsh",) {
+		SETUP("High-dimensional blobs") {
+			datagen::spec s;
+			s.n = 4000;
+			s.clusters = 32;
+			s.seed = 3;
+			auto points = datagen::generate<float, 64>(s);
+			auto inertia = [&points](const std::tuple<std::vector<std::array<float, 64>>, std::vector<uint32_t>>& r) {
+				double total = 0.0;
+				for (size_t i = 0; i < points.size(); ++i) {
+					total += dkm::details::distance_squared(points[i], std::get<0>(r)[std::get<1>(r)[i]]);
+				}
+				return total;
+			};
+
+			SECTION("Inertia is close to the exact assignment") {
+				auto exact = tested::kmeans_lloyd(points, 32, 20, 1);
+				auto approximate = dkm::kmeans_lsh(points, 32, 20, 1, 0.0f, 6, 8);
+				EXPECT(std::get<1>(approximate).size() == points.size());
+				EXPECT(std::get<0>(approximate).size() == 32u);
+				EXPECT(inertia(approximate) <= 1.1 * inertia(exact));
+			}
+
+			SECTION("A point never moves to a farther mean than its previous one") {
+				auto means = dkm::details::random_plusplus(points, 32, 1);
+				auto labels = dkm::details::calculate_clusters(points, means);
+				auto moved = means;
+				for (auto& m : moved) {
+					m[0] += 1.0f;
+				}
+				dkm::details::sign_projection_hash<float, 64> hash(points, 4, 2, 1);
+				std::vector<uint32_t> codes(points.size() * 2);
+				for (size_t i = 0; i < points.size(); ++i) {
+					hash.hash(points[i], &codes[i * 2]);
+				}
+				auto updated = labels;
+				dkm::details::calculate_clusters_lsh(points, moved, hash, codes, updated);
+				for (size_t i = 0; i < points.size(); ++i) {
+					EXPECT(dkm::details::distance_squared(points[i], moved[updated[i]])
+						<= dkm::details::distance_squared(points[i], moved[labels[i]]));
+				}
+			}
+		}
+	},
+	CASE("Test dkm::merge_models",) {
+		SETUP() {
+			datagen::spec s;
+			s.n = 4000;
+			s.clusters = 5;
+			s.seed = 12;
+			s.separation = 20.0;
+			auto points = datagen::generate<double, 2>(s);
+			// four shards, each clustered on its own into more clusters than the data has
+			std::vector<dkm::cluster_model<double, 2>> models;
+			for (size_t shard = 0; shard < 4; ++shard) {
+				std::vector<std::array<double, 2>> part(
+					points.begin() + shard * 1000, points.begin() + (shard + 1) * 1000);
+				models.push_back(dkm::make_model(part, tested::kmeans_lloyd(part, 8, 100, static_cast<int>(shard) + 1)));
+			}
+			double total_sse = 0.0;
+			for (auto& model : models) {
+				for (auto e : model.sse) {
+					total_sse += e;
+				}
+			}
+
+			SECTION("Merged statistics describe the original points") {
+				auto left = dkm::merge_models<double, 2>({models[0], models[1]}, 5, 100, 1);
+				auto right = dkm::merge_models<double, 2>({models[2], models[3]}, 5, 100, 2);
+				auto tree = dkm::merge_models<double, 2>({left, right}, 5, 100, 3);
+				auto flat = dkm::merge_models(models, 5, 100, 4);
+				auto full = dkm::make_model(points, tested::kmeans_lloyd(points, 5, 100, 5));
+				for (auto merged : {tree, flat}) {
+					EXPECT(merged.means.size() == 5u);
+					uint64_t count = 0;
+					std::array<double, 2> sum{};
+					double sse = 0.0;
+					for (size_t j = 0; j < merged.means.size(); ++j) {
+						count += merged.counts[j];
+						sse += merged.sse[j];
+						for (size_t d = 0; d < 2; ++d) {
+							sum[d] += merged.means[j][d] * static_cast<double>(merged.counts[j]);
+						}
+					}
+					EXPECT(count == 4000u);
+					// the overall mean is preserved exactly, up to rounding
+					auto overall = dkm::means_from_labels(points, std::vector<uint32_t>(4000, 0), 1)[0];
+					EXPECT(sum[0] / 4000.0 == lest::approx(overall[0]));
+					EXPECT(sum[1] / 4000.0 == lest::approx(overall[1]));
+					// merging only adds within-cluster spread, and finds the clusters of the full data
+					EXPECT(sse >= total_sse);
+					double full_sse = 0.0;
+					for (auto e : full.sse) {
+						full_sse += e;
+					}
+					EXPECT(sse == lest::approx(full_sse).epsilon(0.01));
+				}
+			}
+
+			SECTION("Merging k or fewer clusters returns them") {
+				auto merged = dkm::merge_models<double, 2>({models[0]}, 8);
+				EXPECT(merged.means == models[0].means);
+				EXPECT(merged.counts == models[0].counts);
+				EXPECT(merged.sse == models[0].sse);
+			}
+		}
+	},
+
+	CASE("Test dkm::pca_projection and dkm::sparse_random_projection",) {
+		SETUP("Points on a plane embedded in 32 dimensions") {
+			std::mt19937 engine(9);
+			std::normal_distribution<double> normal(0.0, 1.0);
+			std::array<double, 32> u, v;
+			for (size_t j = 0; j < 32; ++j) {
+				u[j] = normal(engine);
+				v[j] = normal(engine);
+			}
+			std::vector<std::array<double, 32>> points(2000);
+			for (size_t i = 0; i < points.size(); ++i) {
+				double a = 10.0 * normal(engine) + (i % 2 == 0 ? 40.0 : -40.0), b = 3.0 * normal(engine);
+				for (size_t j = 0; j < 32; ++j) {
+					points[i][j] = 5.0 + a * u[j] + b * v[j];
+				}
+			}
+
+			SECTION("PCA preserves distances of points in a subspace") {
+				dkm::pca_projection<double, 32, 2> pca(points, 1);
+				auto projected = pca.transform(points, 2);
+				EXPECT(projected.size() == points.size());
+				EXPECT(pca.variances()[0] >= pca.variances()[1]);
+				for (size_t i = 1; i < points.size(); i += 97) {
+					double original = dkm::details::distance(points[i], points[0]);
+					double reduced = dkm::details::distance(projected[i], projected[0]);
+					EXPECT(reduced == lest::approx(original).epsilon(1e-6).scale(original));
+				}
+			}
+
+			SECTION("Random projection approximately preserves distances") {
+				dkm::sparse_random_projection<double, 32, 16> jl(1);
+				auto projected = jl.transform(points);
+				double ratio = 0.0;
+				for (size_t i = 1; i < points.size(); ++i) {
+					ratio += dkm::details::distance_squared(projected[i], projected[0])
+						/ dkm::details::distance_squared(points[i], points[0]);
+				}
+				ratio /= static_cast<double>(points.size() - 1);
+				EXPECT(ratio > 0.5);
+				EXPECT(ratio < 2.0);
+			}
+
+			SECTION("Clustering the projection gives full-dimensional means") {
+				dkm::pca_projection<double, 32, 2> pca(points, 1);
+				auto result = dkm::kmeans_projected(points, 2, pca, 100, 1);
+				auto& labels = std::get<1>(result);
+				auto& means = std::get<0>(result);
+				EXPECT(means.size() == 2u);
+				EXPECT(means == dkm::means_from_labels(points, labels, 2));
+				for (size_t i = 2; i < points.size(); ++i) {
+					EXPECT(labels[i] == labels[i % 2]);
+				}
+			}
+		}
+	},
+	CASE("Test dkm::load_csv, dkm::standardize and dkm::kmeans_csv",) {
+		SETUP("Two features of very different magnitude") {
+			// the second feature separates the clusters but is a thousand times smaller than the first
+			std::stringstream csv;
+			csv << "loudness,pitch\n";
+			std::mt19937 engine(2);
+			std::normal_distribution<double> noise(0.0, 1.0);
+			for (int i = 0; i < 400; ++i) {
+				csv << 5000.0 + 1000.0 * noise(engine) << ", " << (i % 2 == 0 ? 1.0 : -1.0) + 0.1 * noise(engine)
+					<< "\n";
+			}
+			csv << "\n";
+
+			SECTION("Loading computes the statistics of the parsed points") {
+				dkm::column_statistics<2> stats;
+				auto points = dkm::load_csv<double, 2>(csv, stats);
+				EXPECT(points.size() == 400u);
+				EXPECT(stats.count == 400u);
+				EXPECT(stats.skipped == 1u);
+				for (size_t d = 0; d < 2; ++d) {
+					double mean = 0.0, variance = 0.0;
+					for (auto& p : points) {
+						mean += p[d];
+					}
+					mean /= 400.0;
+					for (auto& p : points) {
+						variance += (p[d] - mean) * (p[d] - mean);
+					}
+					variance /= 400.0;
+					EXPECT(stats.mean[d] == lest::approx(mean));
+					EXPECT(stats.variance(d) == lest::approx(variance));
+				}
+				auto copy = points;
+				dkm::standardize(copy, stats, 3);
+				auto restored = dkm::unstandardize(copy, stats);
+				for (size_t i = 0; i < points.size(); ++i) {
+					EXPECT(restored[i][0] == lest::approx(points[i][0]));
+					EXPECT(restored[i][1] == lest::approx(points[i][1]));
+				}
+			}
+
+			SECTION("Clustering z-scores separates on the small feature") {
+				auto result = dkm::kmeans_csv<double, 2>(csv, 2, 100, 3);
+				auto& labels = std::get<1>(result);
+				auto& means = std::get<0>(result);
+				for (size_t i = 2; i < labels.size(); ++i) {
+					EXPECT(labels[i] == labels[i % 2]);
+				}
+				EXPECT(means[labels[0]][1] == lest::approx(1.0).epsilon(0.05));
+				EXPECT(means[labels[1]][1] == lest::approx(-1.0).epsilon(0.05));
+				EXPECT(means[labels[0]][0] == lest::approx(5000.0).epsilon(0.05));
+			}
+		}
+	},
 };
 
 int main(int argc, char** argv) {
@@ -0,0 +1,368 @@
+/*
+Differential validation harness for dkm.hpp
+
+Every k-means variant registered in `variants()` is run on randomly generated datasets over a grid of
+point counts (n), cluster counts (k), dimensions (N), value types (T) and data distributions. Each variant
+is seeded identically to the reference `dkm::kmeans_lloyd` and must reproduce its labels exactly and its
+means within a tolerance. The speedup of each variant relative to the reference is reported as well.
+
+Usage: dkm_validate [-v] [seed]
+*/
+
+#include "../../include/dkm.hpp"
+#include "../../include/dkm_grid.hpp"
+#include "../../include/dkm_lsh.hpp"
+
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <random>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+namespace {
+
+template <typename T, size_t N>
+using clustering_result = std::tuple<std::vector<std::array<T, N>>, std::vector<uint32_t>>;
+
+template <typename T, size_t N>
+using kmeans_function = std::function<clustering_result<T, N>(
+	const std::vector<std::array<T, N>>&, uint32_t, int, int, float)>;
+
+/*
+A k-means implementation under test. Exact variants must produce the same labels as the reference, approximate
+variants are only reported.
+*/
+template <typename T, size_t N>
+struct variant {
+	std::string name;
+	bool exact;
+	kmeans_function<T, N> run;
+};
+
+/*
+Straightforward Lloyd iteration without any of the library's kernels except for the seeding and the
+convergence test, which define the behaviour every variant has to reproduce.
+*/
+template <typename T, size_t N>
+clustering_result<T, N> naive_lloyd(
+	const std::vector<std::array<T, N>>& data, uint32_t k, int max_iter, int seed, float epsilon) {
+	auto means = dkm::details::random_plusplus(data, k, seed);
+	std::vector<uint32_t> labels(data.size());
+	std::vector<std::array<T, N>> old_means;
+	int count = 0;
+	do {
+		for (size_t i = 0; i < data.size(); ++i) {
+			T best = std::numeric_limits<T>::max();
+			for (uint32_t j = 0; j < k; ++j) {
+				T d = T();
+				for (size_t dim = 0; dim < N; ++dim) {
+					T delta = data[i][dim] - means[j][dim];
+					d += delta * delta;
+				}
+				if (j == 0 || d < best) {
+					best = d;
+					labels[i] = j;
+				}
+			}
+		}
+		old_means = means;
+		std::vector<std::array<T, N>> sums(k);
+		std::vector<T> counts(k, T());
+		for (size_t i = 0; i < data.size(); ++i) {
+			counts[labels[i]] += 1;
+			for (size_t dim = 0; dim < N; ++dim) {
+				sums[labels[i]][dim] += data[i][dim];
+			}
+		}
+		for (uint32_t j = 0; j < k; ++j) {
+			if (counts[j] != T()) {
+				for (size_t dim = 0; dim < N; ++dim) {
+					means[j][dim] = sums[j][dim] / counts[j];
+				}
+			}
+		}
+		++count;
+	} while (dkm::details::point_collection_epsilon(means, old_means) > epsilon && count < max_iter);
+	return clustering_result<T, N>(means, labels);
+}
+
+/*
+dkm::kmeans_grid only exists for points of up to 3 dimensions.
+*/
+template <typename T, size_t N>
+void add_grid_variant(std::vector<variant<T, N>>& result, std::true_type) {
+	result.push_back({"grid", true,
+		[](const std::vector<std::array<T, N>>& data, uint32_t k, int max_iter, int seed, float epsilon) {
+			return dkm::kmeans_grid(data, k, max_iter, seed, epsilon);
+		}});
+}
+
+template <typename T, size_t N>
+void add_grid_variant(std::vector<variant<T, N>>&, std::false_type) {}
+
+/*
+The registry of variants compared against dkm::kmeans_lloyd. Accelerated implementations are added here.
+*/
+template <typename T, size_t N>
+std::vector<variant<T, N>> variants() {
+	std::vector<variant<T, N>> result;
+	result.push_back({"naive", true, naive_lloyd<T, N>});
+	result.push_back({"annulus", true,
+		[](const std::vector<std::array<T, N>>& data, uint32_t k, int max_iter, int seed, float epsilon) {
+			return dkm::kmeans_lloyd(data, k, max_iter, seed, epsilon, dkm::assignment::annulus);
+		}});
+	result.push_back({"exponion", true,
+		[](const std::vector<std::array<T, N>>& data, uint32_t k, int max_iter, int seed, float epsilon) {
+			return dkm::kmeans_lloyd(data, k, max_iter, seed, epsilon, dkm::assignment::exponion);
+		}});
+	result.push_back({"ball", true,
+		[](const std::vector<std::array<T, N>>& data, uint32_t k, int max_iter, int seed, float epsilon) {
+			return dkm::kmeans_lloyd(data, k, max_iter, seed, epsilon, dkm::assignment::ball);
+		}});
+	add_grid_variant(result, std::integral_constant<bool, N <= 3>());
+	result.push_back({"lsh", false,
+		[](const std::vector<std::array<T, N>>& data, uint32_t k, int max_iter, int seed, float epsilon) {
+			return dkm::kmeans_lsh(data, k, max_iter, seed, epsilon);
+		}});
+	return result;
+}
+
+enum class distribution { uniform, blobs, ties, duplicates, degenerate };
+
+const char* distribution_name(distribution d) {
+	switch (d) {
+	case distribution::uniform:
+		return "uniform";
+	case distribution::blobs:
+		return "blobs";
+	case distribution::ties:
+		return "ties";
+	case distribution::duplicates:
+		return "duplicates";
+	case distribution::degenerate:
+		return "degenerate";
+	}
+	return "unknown";
+}
+
+/*
+Generate n points of the given distribution. `ties` places points on a coarse integer lattice so that many
+point-mean distances compare equal, `duplicates` draws every point from a small pool, and `degenerate` puts
+almost all points on a single location so that most clusters end up empty.
+*/
+template <typename T, size_t N>
+std::vector<std::array<T, N>> generate(distribution dist, size_t n, uint32_t k, std::mt19937& engine) {
+	std::vector<std::array<T, N>> data(n);
+	std::uniform_real_distribution<double> uniform(-100.0, 100.0);
+	std::normal_distribution<double> normal(0.0, 1.0);
+	std::uniform_int_distribution<int> lattice(-3, 3);
+	switch (dist) {
+	case distribution::uniform:
+		for (auto& p : data) {
+			for (auto& v : p) {
+				v = static_cast<T>(uniform(engine));
+			}
+		}
+		break;
+	case distribution::blobs: {
+		std::vector<std::array<double, N>> centres(k);
+		for (auto& c : centres) {
+			for (auto& v : c) {
+				v = uniform(engine);
+			}
+		}
+		std::uniform_int_distribution<uint32_t> pick(0, k - 1);
+		for (auto& p : data) {
+			auto& c = centres[pick(engine)];
+			for (size_t dim = 0; dim < N; ++dim) {
+				p[dim] = static_cast<T>(c[dim] + 5.0 * normal(engine));
+			}
+		}
+		break;
+	}
+	case distribution::ties:
+		for (auto& p : data) {
+			for (auto& v : p) {
+				v = static_cast<T>(lattice(engine));
+			}
+		}
+		break;
+	case distribution::duplicates: {
+		size_t pool_size = std::max<size_t>(k, n / 10);
+		std::uniform_int_distribution<size_t> pick(0, pool_size - 1);
+		for (size_t i = 0; i < pool_size && i < n; ++i) {
+			for (auto& v : data[i]) {
+				v = static_cast<T>(uniform(engine));
+			}
+		}
+		for (size_t i = pool_size; i < n; ++i) {
+			data[i] = data[pick(engine)];
+		}
+		break;
+	}
+	case distribution::degenerate:
+		for (size_t i = 0; i < n; ++i) {
+			for (auto& v : data[i]) {
+				v = i % 50 == 0 ? static_cast<T>(uniform(engine)) : T(1);
+			}
+		}
+		break;
+	}
+	return data;
+}
+
+struct summary {
+	size_t cases = 0;
+	size_t failures = 0;
+	double log_speedup = 0.0;
+	double worst_inertia_gap = 0.0;
+};
+
+struct options {
+	bool verbose = false;
+	uint32_t seed = 1234;
+};
+
+template <typename T, size_t N>
+double inertia(const std::vector<std::array<T, N>>& data, const clustering_result<T, N>& result) {
+	double total = 0.0;
+	for (size_t i = 0; i < data.size(); ++i) {
+		total += static_cast<double>(dkm::details::distance_squared(data[i], std::get<0>(result)[std::get<1>(result)[i]]));
+	}
+	return total;
+}
+
+template <typename T, size_t N>
+double max_mean_error(const std::vector<std::array<T, N>>& a, const std::vector<std::array<T, N>>& b) {
+	double error = 0.0;
+	for (size_t i = 0; i < std::min(a.size(), b.size()); ++i) {
+		for (size_t dim = 0; dim < N; ++dim) {
+			double scale = std::max(1.0, std::abs(static_cast<double>(a[i][dim])));
+			error = std::max(error, std::abs(static_cast<double>(a[i][dim]) - static_cast<double>(b[i][dim])) / scale);
+		}
+	}
+	return error;
+}
+
+template <typename F>
+double time_seconds(F&& f) {
+	auto start = std::chrono::high_resolution_clock::now();
+	f();
+	auto end = std::chrono::high_resolution_clock::now();
+	return std::chrono::duration<double>(end - start).count();
+}
+
+/*
+Run every registered variant of a single type/dimension combination across the n/k/distribution grid.
+*/
+template <typename T, size_t N>
+void validate(const char* type_name, const options& opts, std::map<std::string, summary>& summaries) {
+	const double tolerance = std::is_same<T, float>::value ? 1e-4 : 1e-9;
+	const int max_iter = 100;
+	const std::array<size_t, 3> point_counts{{64, 500, 2000}};
+	const std::array<uint32_t, 4> cluster_counts{{1, 2, 7, 32}};
+	const std::array<distribution, 5> distributions{{distribution::uniform,
+		distribution::blobs,
+		distribution::ties,
+		distribution::duplicates,
+		distribution::degenerate}};
+	auto registered = variants<T, N>();
+
+	std::mt19937 engine(opts.seed + static_cast<uint32_t>(N) * 7919u + static_cast<uint32_t>(sizeof(T)));
+	for (auto n : point_counts) {
+		for (auto k : cluster_counts) {
+			if (k > n) {
+				continue;
+			}
+			for (auto dist : distributions) {
+				auto data = generate<T, N>(dist, n, k, engine);
+				int seed = static_cast<int>(engine() & 0x7fffffff);
+
+				clustering_result<T, N> expected;
+				double reference_time = time_seconds(
+					[&] { expected = dkm::kmeans_lloyd(data, k, max_iter, seed); });
+				double expected_inertia = inertia(data, expected);
+
+				for (auto& v : registered) {
+					clustering_result<T, N> actual;
+					double variant_time = time_seconds([&] { actual = v.run(data, k, max_iter, seed, 0.0f); });
+					double speedup = reference_time / std::max(variant_time, 1e-9);
+					double inertia_gap = (inertia(data, actual) - expected_inertia) / std::max(expected_inertia, 1e-12);
+					double mean_error = max_mean_error(std::get<0>(expected), std::get<0>(actual));
+					size_t label_mismatches = 0;
+					for (size_t i = 0; i < std::min(std::get<1>(expected).size(), std::get<1>(actual).size()); ++i) {
+						label_mismatches += std::get<1>(expected)[i] != std::get<1>(actual)[i];
+					}
+					bool ok = std::get<1>(actual).size() == data.size() && std::get<0>(actual).size() == k;
+					if (v.exact) {
+						ok = ok && label_mismatches == 0 && mean_error <= tolerance;
+					}
+
+					auto& s = summaries[v.name];
+					++s.cases;
+					s.log_speedup += std::log(speedup);
+					s.worst_inertia_gap = std::max(s.worst_inertia_gap, inertia_gap);
+					if (!ok) {
+						++s.failures;
+					}
+					if (!ok || opts.verbose) {
+						std::cout << (ok ? "ok   " : "FAIL ") << std::setw(12) << v.name << " T=" << type_name
+								  << " N=" << N << " n=" << n << " k=" << k << " dist=" << distribution_name(dist)
+								  << " seed=" << seed << " label_mismatches=" << label_mismatches
+								  << " mean_error=" << mean_error << " inertia_gap=" << inertia_gap
+								  << " speedup=" << speedup << std::endl;
+					}
+				}
+			}
+		}
+	}
+}
+
+template <typename T>
+void validate_dimensions(const char* type_name, const options& opts, std::map<std::string, summary>& summaries) {
+	validate<T, 1>(type_name, opts, summaries);
+	validate<T, 2>(type_name, opts, summaries);
+	validate<T, 3>(type_name, opts, summaries);
+	validate<T, 8>(type_name, opts, summaries);
+	validate<T, 32>(type_name, opts, summaries);
+	validate<T, 128>(type_name, opts, summaries);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+	options opts;
+	for (int i = 1; i < argc; ++i) {
+		if (std::strcmp(argv[i], "-v") == 0) {
+			opts.verbose = true;
+		} else {
+			opts.seed = static_cast<uint32_t>(std::strtoul(argv[i], nullptr, 10));
+		}
+	}
+
+	std::map<std::string, summary> summaries;
+	validate_dimensions<float>("float", opts, summaries);
+	validate_dimensions<double>("double", opts, summaries);
+
+	size_t failures = 0;
+	std::cout << "variant          cases  failures  speedup(geomean)  worst inertia gap" << std::endl;
+	for (auto& entry : summaries) {
+		auto& s = entry.second;
+		std::cout << std::left << std::setw(16) << entry.first << std::right << std::setw(6) << s.cases
+				  << std::setw(10) << s.failures << std::setw(18) << std::exp(s.log_speedup / s.cases)
+				  << std::setw(19) << s.worst_inertia_gap << std::endl;
+		failures += s.failures;
+	}
+	return failures == 0 ? 0 : 1;
+}